@@ -0,0 +1,297 @@
+// Benchmark harness: runs every workload several times, timing tokenizing, parsing and evaluation separately,
+// and compares the median times against a stored baseline
+// Workloads are the `.rr` files in this directory, plus long scripts generated below (RR has no loops yet,
+// so repeated work is written out line by line).
+// Build and run with `make bench`; run `./bench.out --help` for the options.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <dirent.h>
+
+#define RR_ALLOC_HOOK //time the interpreter with the allocator it runs with
+
+#include "../src/tokenizer.h"
+#include "../src/parser.h"
+#include "../src/environment.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+const string BENCH_DIR = "bench";
+const string DEFAULT_BASELINE = "bench/baseline.txt";
+const int DEFAULT_REPS = 5;
+//a phase is flagged when it's this many percent slower than the baseline...
+const double DEFAULT_TOLERANCE = 15;
+//...and slower by at least this many ms, so tiny phases don't flag on noise
+const double NOISE_MS = 2.0;
+
+/*
+    Structs
+*/
+
+struct Workload {
+    string name;
+    string source;
+};
+
+//median milliseconds of each phase
+struct Timing {
+    double tokenize_ms;
+    double parse_ms;
+    double eval_ms;
+
+    double total() const {
+        return tokenize_ms + parse_ms + eval_ms;
+    }
+};
+
+struct BenchOptions {
+    int reps = DEFAULT_REPS;
+    bool save = false;
+    string baseline = DEFAULT_BASELINE;
+    double tolerance = DEFAULT_TOLERANCE;
+    vector<string> only; //run just these workloads; all when empty
+};
+
+/*
+    Generated workloads
+*/
+
+//scalar Int and Float arithmetic, comparisons and builtin calls
+string gen_arith(int lines) {
+    stringstream src;
+    src << "a = 1\nb = 2.5\nc = 0\n";
+    for(int i = 0; i < lines; i++) {
+        switch(i % 4) {
+            case 0: src << "a = a + " << i % 97 << " * 3\n"; break;
+            case 1: src << "b = b + 0.25 + a\n"; break;
+            case 2: src << "c = max(a, " << i << ") + round(b)\n"; break;
+            case 3: src << "d = a == c\n"; break;
+        }
+    }
+    src << "a\n";
+    return src.str();
+}
+
+//building strings: StrBuilder appends, concatenation and repetition
+string gen_strings(int lines) {
+    stringstream src;
+    src << "sb = StrBuilder(\"start\")\n";
+    for(int i = 0; i < lines; i++) {
+        switch(i % 4) {
+            case 0: src << "append(sb, \"abc\")\n"; break;
+            case 1: src << "append(sb, " << i << ")\n"; break;
+            case 2: src << "s = \"key\" + " << i << " + \"value\"\n"; break;
+            case 3: src << "r = \"ab\" repeat " << i % 16 << "\n"; break;
+        }
+    }
+    src << "len(Str(sb))\n";
+    return src.str();
+}
+
+//reading and writing elements of a List, slicing and gathering
+string gen_list_index(int lines) {
+    const int LIST_LEN = 1000;
+    stringstream src;
+    src << "l = [";
+    for(int i = 0; i < LIST_LEN; i++) src << (i > 0 ? ", " : "") << i;
+    src << "]\n";
+    for(int i = 0; i < lines; i++) {
+        int a = (i * 7919) % LIST_LEN, b = (i * 104729) % LIST_LEN;
+        switch(i % 4) {
+            case 0: src << "x = l[" << a << "] + l[" << b << "]\n"; break;
+            case 1: src << "l[" << a << "] = x\n"; break;
+            case 2: src << "s = sum(l[" << min(a, b) << ":" << max(a, b) + 1 << "])\n"; break;
+            case 3: src << "n = len(l[[" << a << ", " << b << ", 3]])\n"; break;
+        }
+    }
+    src << "sum(l)\n";
+    return src.str();
+}
+
+//a long script of nested expressions, where tokenizing and parsing are most of the work
+string gen_parse_large(int lines) {
+    stringstream src;
+    src << "v = 0\n";
+    for(int i = 0; i < lines; i++) {
+        src << "v" << i % 10 << " = (" << i << " + 2 * (3 + 4 * (v + 6))) * [1, 2, " << i << "][1] + max(" << i << ", 7)";
+        src << " // a comment that the tokenizer has to skip\n";
+    }
+    src << "v9\n";
+    return src.str();
+}
+
+/*
+    Functions
+*/
+
+double elapsed_ms(chrono::steady_clock::time_point since) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+string read_file(const string& path) {
+    ifstream file(path);
+    stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+//the `.rr` files in the bench directory, by name, then the generated workloads
+vector<Workload> all_workloads() {
+    vector<Workload> workloads;
+    vector<string> files;
+    DIR* dir = opendir(BENCH_DIR.c_str());
+    if(dir != nullptr) {
+        while(dirent* entry = readdir(dir)) {
+            string name = entry->d_name;
+            if(name.size() > 3 && name.substr(name.size() - 3) == ".rr") files.push_back(name);
+        }
+        closedir(dir);
+    }
+    sort(files.begin(), files.end());
+    for(int i = 0; i < files.size(); i++) {
+        workloads.push_back({files[i].substr(0, files[i].size() - 3), read_file(BENCH_DIR + "/" + files[i])});
+    }
+    workloads.push_back({"arith", gen_arith(40000)});
+    workloads.push_back({"strings", gen_strings(40000)});
+    workloads.push_back({"list_index", gen_list_index(20000)});
+    workloads.push_back({"parse_large", gen_parse_large(20000)});
+    return workloads;
+}
+
+double median(vector<double> samples) {
+    sort(samples.begin(), samples.end());
+    size_t mid = samples.size() / 2;
+    return samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+}
+
+//run `workload` from scratch `reps` times, after one untimed warm-up run; each run gets a fresh environment
+Timing run_workload(const Workload& workload, int reps) {
+    vector<double> tokenize, parse, eval;
+    for(int r = 0; r <= reps; r++) {
+        Env env = Env();
+        Env::init_with_default(env);
+
+        auto start = chrono::steady_clock::now();
+        vector<Token> tokens = Tokenizer::from_source(workload.source).tokenize();
+        tokenize.push_back(elapsed_ms(start));
+
+        start = chrono::steady_clock::now();
+        ASTNode* compiled = Parser::from_tokens(tokens).parse(env);
+        parse.push_back(elapsed_ms(start));
+
+        start = chrono::steady_clock::now();
+        {
+            RRObj result = compiled->eval(env);
+        }
+        eval.push_back(elapsed_ms(start));
+        //the AST is never released by the interpreter either
+    }
+    tokenize.erase(tokenize.begin());
+    parse.erase(parse.begin());
+    eval.erase(eval.begin());
+    return {median(tokenize), median(parse), median(eval)};
+}
+
+//baseline timings by workload name; one `name tokenize_ms parse_ms eval_ms` per line
+map<string, Timing> read_baseline(const string& path) {
+    map<string, Timing> baseline;
+    ifstream file(path);
+    string name;
+    Timing timing;
+    while(file >> name >> timing.tokenize_ms >> timing.parse_ms >> timing.eval_ms) baseline[name] = timing;
+    return baseline;
+}
+
+void write_baseline(const string& path, const vector<pair<string, Timing>>& results) {
+    //keep the baseline of workloads that weren't run this time
+    map<string, Timing> baseline = read_baseline(path);
+    for(int i = 0; i < results.size(); i++) baseline[results[i].first] = results[i].second;
+    ofstream file(path);
+    for(auto& entry : baseline) {
+        file << entry.first << " " << entry.second.tokenize_ms << " " << entry.second.parse_ms << " " << entry.second.eval_ms << "\n";
+    }
+}
+
+//names of the phases that got slower than in the baseline
+string regressions(const Timing& now, const Timing& base, double tolerance) {
+    string slower;
+    auto check = [&](const string& phase, double now_ms, double base_ms) {
+        if(now_ms > base_ms * (1 + tolerance / 100) && now_ms - base_ms > NOISE_MS) slower += (slower.empty() ? "" : ", ") + phase;
+    };
+    check("tokenize", now.tokenize_ms, base.tokenize_ms);
+    check("parse", now.parse_ms, base.parse_ms);
+    check("eval", now.eval_ms, base.eval_ms);
+    return slower;
+}
+
+BenchOptions parse_options(int argc, char** argv) {
+    BenchOptions options;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--reps" && i + 1 < argc) {
+            options.reps = max(1, atoi(argv[++i]));
+        } else if(arg == "--save") {
+            options.save = true;
+        } else if(arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = atof(argv[++i]);
+        } else if(arg == "--baseline" && i + 1 < argc) {
+            options.baseline = argv[++i];
+        } else if(arg == "--help") {
+            cout << "usage: ./bench.out [--reps N] [--tolerance PCT] [--save] [--baseline FILE] [workload...]\n"
+                 << "  --reps N         runs per workload; medians are reported (default " << DEFAULT_REPS << ")\n"
+                 << "  --tolerance PCT  how much slower than the baseline a phase may get (default " << DEFAULT_TOLERANCE << "%)\n"
+                 << "  --save           store the timings as the new baseline\n"
+                 << "  --baseline FILE  baseline to compare with (default " << DEFAULT_BASELINE << ")\n"
+                 << "exits with 1 when a phase got slower than its baseline by more than the tolerance\n";
+            exit(0);
+        } else {
+            options.only.push_back(arg);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = parse_options(argc, argv);
+    init_datatypes();
+
+    map<string, Timing> baseline = read_baseline(options.baseline);
+    vector<pair<string, Timing>> results;
+    bool regressed = false;
+    printf("%-14s %11s %11s %11s %11s  %s\n", "workload", "tokenize ms", "parse ms", "eval ms", "total ms", "vs baseline");
+    for(Workload& workload : all_workloads()) {
+        if(!options.only.empty() && find(options.only.begin(), options.only.end(), workload.name) == options.only.end()) continue;
+        Timing timing = run_workload(workload, options.reps);
+        results.push_back({workload.name, timing});
+        printf("%-14s %11.2f %11.2f %11.2f %11.2f  ", workload.name.c_str(), timing.tokenize_ms, timing.parse_ms, timing.eval_ms, timing.total());
+        auto base = baseline.find(workload.name);
+        if(base == baseline.end()) {
+            printf("no baseline\n");
+            continue;
+        }
+        printf("%+.1f%%", (timing.total() / base->second.total() - 1) * 100);
+        string slower = regressions(timing, base->second, options.tolerance);
+        if(!slower.empty()) {
+            printf("  REGRESSION: %s", slower.c_str());
+            regressed = true;
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    if(options.save) {
+        write_baseline(options.baseline, results);
+        printf("baseline saved to %s\n", options.baseline.c_str());
+    }
+    rr_out.flush();
+    return regressed && !options.save ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+// A host program using librr: compiles a script once, then runs it against many inputs
+// Build and run with `make embed.out && ./embed.out`.
+
+#include <iostream>
+#include <chrono>
+
+#include "../src/librr.h"
+
+using namespace std;
+
+int main() {
+    //the script reads `price`, `count` and `tags`, which the host sets before each run
+    rr::Program program = rr::compile(
+        "total = price * count + 5\n"
+        "label = \"order of \" + count\n"
+        "[total, label, len(tags)]\n"
+    );
+    if(!program.ok()) {
+        cerr << program.error() << endl;
+        return 1;
+    }
+
+    rr::Env env;
+    env.set("tags", rr::Value(vector<string>{"new", "express"}));
+    for(long long count = 1; count <= 3; count++) {
+        env.set("price", rr::Value(12));
+        env.set("count", rr::Value(count));
+        rr::Result result = program.run(env);
+        if(!result) {
+            cerr << result.error << endl;
+            return 1;
+        }
+        cout << result.value.list[0].i << ", " << result.value.list[1].str << ", " << result.value.list[2].i << endl;
+    }
+
+    //errors come back as results; the host keeps running
+    rr::Result missing = rr::compile("price + discount").run(env);
+    cout << "error: " << missing.error << endl;
+    rr::Result bad_syntax = rr::compile("price +* 2").run(env);
+    cout << "error: " << bad_syntax.error << endl;
+
+    //`print` output can be collected instead of going to stdout
+    rr::set_output(nullptr);
+    rr::compile("print(\"from the script\")").run(env);
+    string printed = rr::take_output();
+    rr::set_output(stdout);
+    cout << "collected: " << printed;
+
+    const int RUNS = 200000;
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < RUNS; i++) {
+        env.set("count", rr::Value(i));
+        program.run(env);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << RUNS / seconds << " runs per second" << endl;
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Tests of librr as a host program sees it: failing scripts come back as errors, and leave the Env as it was
+// Build and run with `make embed_test`.
+
+#include <iostream>
+#include <string>
+
+#include "../src/librr.h"
+
+using namespace std;
+
+int failed = 0;
+
+void check(bool ok, const string& what) {
+    if(ok) return;
+    cout << "--FAILED: " << what << endl;
+    failed++;
+}
+
+bool contains(const string& text, const string& part) {
+    return text.find(part) != string::npos;
+}
+
+//run `source` in `env`; it should fail with an error containing `error`
+void check_fails(const string& source, rr::Env& env, const string& error) {
+    rr::Result result = rr::compile(source).run(env);
+    check(!result.ok, "'" + source + "' fails");
+    check(contains(result.error, error), "'" + source + "' gives '" + error + "', not '" + result.error + "'");
+}
+
+int main() {
+    rr::set_output(nullptr);
+    rr::Env env;
+
+    //builtins called without an overload for their arguments, including none
+    check_fails("len()", env, "Couldn't find a function 'len<>'");
+    check_fails("print()", env, "Couldn't find a function 'print<>'");
+    check_fails("len(1, 2)", env, "Couldn't find a function 'len<Int,Int>'");
+
+    //parse errors come from `compile`, and `run` gives them back
+    rr::Program overflow = rr::compile("x = 99999999999999999999999");
+    check(!overflow.ok() && contains(overflow.error(), "Int literal out of range"), "out of range literal is a parse error");
+    rr::Result overflow_run = overflow.run(env);
+    check(!overflow_run.ok && overflow_run.parse_error, "running a program that didn't compile fails");
+
+    check_fails("l = [1, 2]\nl[5]", env, "Index out of range: 5");
+
+    //a failed assignment makes no variable, and leaves an existing one as it was
+    check_fails("total = missing + 1", env, "Couldn't find a variable 'missing'");
+    check(!env.has("total"), "failed assignment doesn't make its variable");
+    env.set("total", rr::Value(5));
+    check_fails("total = missing", env, "Couldn't find a variable 'missing'");
+    rr::Value total;
+    check(env.get("total", total) && total.kind == rr::Value::INT && total.i == 5, "failed assignment keeps the old value");
+
+    //the Env still works after all of that
+    env.set("price", rr::Value(12));
+    env.set("count", rr::Value(3));
+    rr::Result result = rr::compile("total = price * count\ntotal").run(env);
+    check(result.ok && result.value.kind == rr::Value::INT && result.value.i == 36, "a good program runs after failed ones");
+    rr::compile("print(\"done\")").run(env);
+    check(rr::take_output() == "Str: done\n", "output is kept for take_output");
+
+    cout << (failed == 0 ? "librr tests passed" : "librr tests failed: " + to_string(failed)) << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+# --repl: feed the .rr files in PATH_TO_TESTS to the REPL line by line through stdin, and compare what it prints
+# with the _out.txt files of the same name in EXPECTED_OUT_DIR (the timings on stderr are left out)
+
+from os import listdir, system
+
+PATH_TO_TESTS = "./examples/repl"
+EXPECTED_OUT_DIR = "tests"
+APPEND_TEST_WITH = "_out.txt"
+EXE_NAME = "a.out"
+
+for file in sorted(listdir(PATH_TO_TESTS)):
+    if not file.endswith(".rr"):
+        continue
+    outfile = file.split(".rr")[0] + APPEND_TEST_WITH
+    print("--" + file + ":")
+    system(f"./{EXE_NAME} --repl < {PATH_TO_TESTS}/{file} 2> /dev/null | diff {PATH_TO_TESTS}/{EXPECTED_OUT_DIR}/{outfile} -")
@@ -0,0 +1,99 @@
+# --profile, --sample and --mem-stats: run the scripts in PATH_TO_TESTS with the flag they're named after, and check the
+# report's structure (its header, and rows for the nodes and builtins that ran); the times change from run to run, so
+# reports aren't compared as a whole. The output of the script itself must be the same as without the flag.
+
+import re
+from subprocess import run
+from tempfile import TemporaryDirectory
+
+PATH_TO_TESTS = "./examples/reports"
+EXE_NAME = "a.out"
+
+failed = 0
+
+def check(ok, what):
+    global failed
+    if not ok:
+        print("  FAILED: " + what)
+        failed += 1
+
+def run_with(flags, file):
+    with open(f"{PATH_TO_TESTS}/{file}") as source:
+        plain = run([f"./{EXE_NAME}"], stdin=source, capture_output=True, text=True).stdout
+    with open(f"{PATH_TO_TESTS}/{file}") as source:
+        result = run([f"./{EXE_NAME}"] + flags, stdin=source, capture_output=True, text=True)
+    check(result.stdout == plain, f"{' '.join(flags)} doesn't change the output")
+    return result.stderr
+
+# --profile: every node that ran is counted (28 of them; not the `else` branch), and the calls taking nearly all the
+# time are among the hot spots; every builtin call is listed
+print("--profile.rr:")
+report = run_with(["--profile"], "profile.rr").splitlines()
+check(len(report) > 0 and re.fullmatch(r"--profile: [0-9.]+ ms total", report[0]) is not None, "header line")
+check("hot spots, by self time:" in report and "builtins, by total time:" in report, "both sections")
+nodes = {}
+more = 0
+builtins = {}
+section = None
+for line in report:
+    if line.startswith("hot spots"): section = nodes
+    elif line.startswith("builtins"): section = builtins
+    node = re.fullmatch(r" +[0-9.]+ +[0-9.]+ +(\d+) +(\d+:\d+) +(.+)", line)
+    builtin = re.fullmatch(r" +[0-9.]+ +(\d+) +(.+)", line)
+    hidden = re.fullmatch(r"  \((\d+) more nodes\)", line)
+    if node and section is nodes: nodes[(node[2], node[3])] = int(node[1])
+    elif builtin and section is builtins: builtins[builtin[2]] = int(builtin[1])
+    elif hidden: more = int(hidden[1])
+check(len(nodes) + more == 28, f"28 nodes ran, not {len(nodes) + more}")
+for node in [("1:5", "runif(...)"), ("2:11", "op *"), ("2:5", "sum(...)")]:
+    check(nodes.get(node) == 1, f"row for {node[1]} at {node[0]}, run once")
+check(builtins == {"runif(Int)": 1, "sum(Vec)": 1, "len(Vec)": 1, "==(Int, Int)": 1, "print(Any)": 1},
+    f"builtin rows: {builtins}")
+
+# --sample: the samples add up to the count in the header, every stack starts at the program's root, and the two calls
+# taking nearly all the CPU time were sampled
+print("--sample.rr:")
+with TemporaryDirectory() as tmp:
+    path = f"{tmp}/samples.folded"
+    report = run_with(["--sample", path], "sample.rr").splitlines()
+    header = re.fullmatch(r"--sample: (\d+) samples written to '(.+)'", report[0]) if report else None
+    check(header is not None and header[2] == path, "header line")
+    stacks = {}
+    with open(path) as samples:
+        for line in samples.read().splitlines():
+            stack = re.fullmatch(r"((?:[^;]+ \d+:\d+;)*[^;]+ \d+:\d+) (\d+)", line)
+            check(stack is not None, f"folded stack line: {line}")
+            if stack: stacks[stack[1]] = int(stack[2])
+    check(header is not None and int(header[1]) > 0 and sum(stacks.values()) == int(header[1]), "samples add up to the header's count")
+    check(all(stack.startswith("{statement} 1:1;") for stack in stacks), "stacks start at the root")
+    for leaf in ["op = 1:3;runif(...) 1:5", "op = 2:3;rnorm(...) 2:5"]:
+        check(any(stack.endswith(leaf) for stack in stacks), f"a stack ending in {leaf}")
+
+# --mem-stats: both header lines, allocations for the interpreter's own structures and for the Vecs, and a row per type of
+# the values the variables hold (two Vecs, a List and two Ints; the Strs are the List's); mem() is more than 0 bytes
+print("--mem-stats.rr:")
+report = run_with(["--mem-stats"], "mem_stats.rr").splitlines()
+check(len(report) > 1 and re.fullmatch(r"--mem-stats: peak RSS [0-9.]+ MB, RSS at exit [0-9.]+ MB", report[0]) is not None,
+    "header line")
+check(len(report) > 1 and re.fullmatch(r"heap: [0-9.]+ MB in \d+ blocks live at exit, peak [0-9.]+ MB", report[1]) is not None,
+    "heap line")
+check("allocations, by what they were made for:" in report and "values held by variables at exit, by type:" in report,
+    "both sections")
+made_for = {}
+held = {}
+section = None
+for line in report:
+    if line.startswith("allocations"): section = made_for
+    elif line.startswith("values held"): section = held
+    row = re.fullmatch(r" +(\d+) +([0-9.]+) +(\w+)", line)
+    if row and section is not None: section[row[3]] = (int(row[1]), float(row[2]))
+check(all(made_for.get(what, (0,))[0] > 0 for what in ["interpreter", "AST", "Env", "Vec", "List"]),
+    f"allocation rows: {made_for}")
+check({type: count for type, (count, _) in held.items()} == {"Vec": 2, "List": 1, "Int": 2, "Str": 2},
+    f"rows of values held: {held}")
+check(held.get("Vec", (0, 0))[1] >= 8, "the Vecs hold at least 8 MB")
+with open(f"{PATH_TO_TESTS}/mem_stats.rr") as source:
+    output = run([f"./{EXE_NAME}"], stdin=source, capture_output=True, text=True).stdout
+check(output.startswith("Bool: 0\n"), "mem() == 0 is false")
+
+print("report tests passed" if failed == 0 else f"report tests failed: {failed}")
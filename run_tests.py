@@ -1,7 +1,10 @@
 # I'm a PY hater and I use PY. I'm a hypocrite, yes.
 # in PATH_TO_TESTS take all .rr files and compare their output with _out.txt files with the same name in EXPECTED_OUT_DIR
+# with `--cache`, every file is run twice with `--cache <dir>`: the first run writes the parsed program, the second loads it
 
 from os import walk, system
+from sys import argv
+from tempfile import TemporaryDirectory
 
 PATH_TO_TESTS = "./examples"
 EXPECTED_OUT_DIR = "tests"
@@ -13,9 +16,13 @@ for (dirpath, dirnames, filenames) in walk(PATH_TO_TESTS):
     f.extend(filenames)
     break
 
+cache = TemporaryDirectory() if "--cache" in argv else None
+runs = [f"./{EXE_NAME} --cache {cache.name}"] * 2 if cache else [f"./{EXE_NAME}"]
+
 # for every file, 
 for file in f:
     # f = open(file, "r")
     outfile = file.split(".rr")[0] + APPEND_TEST_WITH
     print("--" + file + ":")
-    system(f"./{EXE_NAME} < {PATH_TO_TESTS}/{file} | diff {PATH_TO_TESTS}/{EXPECTED_OUT_DIR}/{outfile} -")
\ No newline at end of file
+    for run in runs:
+        system(f"{run} < {PATH_TO_TESTS}/{file} | diff {PATH_TO_TESTS}/{EXPECTED_OUT_DIR}/{outfile} -")
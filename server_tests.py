@@ -0,0 +1,27 @@
+# --serve: send the scripts in PATH_TO_TESTS to one server, in name order and then again (from the cache), and check
+# that each prints what a full run prints; failing scripts must not take the server down for the ones after them
+
+from os import listdir
+from subprocess import Popen, run, DEVNULL
+from tempfile import TemporaryDirectory
+from time import sleep
+
+PATH_TO_TESTS = "./examples/server"
+EXE_NAME = "a.out"
+
+with TemporaryDirectory() as tmp:
+    sock = f"{tmp}/rr.sock"
+    server = Popen([f"./{EXE_NAME}", "--serve", sock, "--workers", "2"], stdout=DEVNULL, stderr=DEVNULL)
+    sleep(0.5)
+    for round in range(2):
+        for file in sorted(listdir(PATH_TO_TESTS)):
+            print("--" + file + ":")
+            with open(f"{PATH_TO_TESTS}/{file}") as source:
+                expected = run([f"./{EXE_NAME}"], stdin=source, capture_output=True, text=True).stdout
+            with open(f"{PATH_TO_TESTS}/{file}") as source:
+                served = run([f"./{EXE_NAME}", "--connect", sock], stdin=source, capture_output=True, text=True).stdout
+            if served != expected:
+                print(f"served:\n{served}full run:\n{expected}")
+    if server.poll() is not None:
+        print(f"the server exited with {server.returncode}")
+    server.kill()
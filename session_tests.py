@@ -0,0 +1,37 @@
+# --session: edit a script version by version, and check that after every edit the session prints what a full run
+# of that version prints last
+# every directory in PATH_TO_TESTS holds the versions of one script, applied in name order
+
+from os import listdir
+from subprocess import Popen, run, DEVNULL
+from tempfile import TemporaryDirectory
+from shutil import copyfile
+from time import sleep
+
+PATH_TO_TESTS = "./examples/session"
+EXE_NAME = "a.out"
+WAIT = 0.5 # the session looks for changes every 100 ms
+
+for test in sorted(listdir(PATH_TO_TESTS)):
+    print("--" + test + ":")
+    versions = sorted(listdir(f"{PATH_TO_TESTS}/{test}"))
+    with TemporaryDirectory() as tmp:
+        script = f"{tmp}/script.rr"
+        copyfile(f"{PATH_TO_TESTS}/{test}/{versions[0]}", script)
+        out = open(f"{tmp}/out.txt", "w+")
+        session = Popen([f"./{EXE_NAME}", "--session", script], stdout=out, stderr=DEVNULL)
+        seen = 0
+        for i, version in enumerate(versions):
+            if i > 0:
+                copyfile(f"{PATH_TO_TESTS}/{test}/{version}", script)
+            sleep(WAIT)
+            out.seek(0)
+            lines = out.read().splitlines()
+            printed = lines[seen:]
+            seen = len(lines)
+            with open(f"{PATH_TO_TESTS}/{test}/{version}") as source:
+                expected = run([f"./{EXE_NAME}"], stdin=source, capture_output=True, text=True).stdout.splitlines()
+            if not printed or printed[-1] != expected[-1]:
+                print(f"{version}: session printed {printed[-1:]}, a full run {expected[-1:]}")
+        session.kill()
+        out.close()
@@ -0,0 +1,201 @@
+// On-disk cache of parsed programs: with `--cache <dir>`, the AST of a script is saved after parsing it,
+// and the next run of the same script loads it back instead of tokenizing and parsing the source again
+// Files are named after a hash of the source, and are only used by the interpreter build that wrote them.
+/*
+    File layout (rr_binary.h conventions: native byte order, every field aligned to 8 bytes):
+    - header: magic "RRAST\0\0\0", u32 version, u32 byte order check (0x01020304)
+    - u64 build stamp of the interpreter that wrote the file
+    - the source, as a Str; the file is only used for exactly this source
+    - u64 size and u64 hash (hash_bytes) of the node section; a file whose nodes don't match the hash isn't used
+    - the nodes, in preorder: u64 type | child count << 8, u64 line | col << 32, then
+      - LITERAL: the value, as an rr_binary.h object record
+      - VAR, FUN, OP: the symbol, as a Str
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "parser.h"
+#include "rr_binary.h"
+#include "mapped_file.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+const char AST_CACHE_MAGIC[8] = {'R', 'R', 'A', 'S', 'T', 0, 0, 0};
+const uint32_t AST_CACHE_VERSION = 2;
+//a tree never needs more nodes than this; bigger counts mean the file is corrupt
+const uint64_t AST_CACHE_MAX_CHILDREN = 1 << 28;
+
+/*
+    Functions
+*/
+
+//FNV-1a
+uint64_t hash_bytes(const char* data, size_t n, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for(size_t i = 0; i < n; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+//changes with every build of the interpreter, since node types and builtins may change with it
+uint64_t ast_cache_build_stamp() {
+    static const char BUILD[] = __DATE__ " " __TIME__;
+    return hash_bytes(BUILD, sizeof(BUILD)) ^ AST_CACHE_VERSION;
+}
+
+//the cache file of `source` in directory `dir`
+string ast_cache_path(const string& dir, const string& source) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.rrast", (unsigned long long) hash_bytes(source.data(), source.size()));
+    return dir + "/" + name;
+}
+
+void write_ast(BinWriter& writer, ASTNode* node) {
+    writer.u64((uint64_t) node->type | (uint64_t) node->children.size() << 8);
+    writer.u64((uint32_t) node->line | (uint64_t) (uint32_t) node->col << 32);
+    switch(node->type) {
+        case ASTType::LITERAL: writer.obj(node->literal); break;
+        case ASTType::VAR:
+        case ASTType::FUN:
+        case ASTType::OP: writer.str(node->symbol); break;
+        default: break;
+    }
+    for(int i = 0; i < node->children.size(); i++) write_ast(writer, node->children[i]);
+}
+
+//whether the parser can make a node of `type` with this many children; evaluating other shapes isn't safe
+bool ast_shape_ok(ASTType type, uint64_t children) {
+    switch(type) {
+        case ASTType::LITERAL:
+        case ASTType::VAR:
+        case ASTType::FUN: return children == 0;
+        case ASTType::OP: return children <= 2; //an op called like a function, a unary op, or a binary op
+        case ASTType::IF: return children == 3;
+        case ASTType::EVALUATE:
+        case ASTType::INDEX: return children == 2;
+        case ASTType::LIST_BUILDER: return children == 1;
+        case ASTType::STATEMENT:
+        case ASTType::CSV: return children <= AST_CACHE_MAX_CHILDREN;
+        default: return false; //the parser never makes the others
+    }
+}
+
+ASTNode* read_ast(BinReader& reader) {
+    uint64_t kind = reader.u64();
+    uint64_t children = kind >> 8;
+    if((kind & 0xff) > ASTType::LIST_BUILDER) rr_runtime_error("Cached program is corrupt");
+    ASTType type = (ASTType) (kind & 0xff);
+    if(!ast_shape_ok(type, children)) rr_runtime_error("Cached program is corrupt");
+    uint64_t position = reader.u64();
+    int line = (uint32_t) position;
+    int col = position >> 32;
+    ASTNode* node;
+    switch(type) {
+        case ASTType::LITERAL: node = new ASTNode(type, reader.obj()); break;
+        case ASTType::VAR:
+        case ASTType::FUN:
+        case ASTType::OP: {
+            string symbol = reader.str();
+            node = new ASTNode(type, symbol);
+        }; break;
+        default: node = new ASTNode(type); break;
+    }
+    node->line = line;
+    node->col = col;
+    try {
+        for(uint64_t i = 0; i < children; i++) node->children.push_back(read_ast(reader));
+    } catch(RRError&) {
+        delete_ast(node);
+        throw;
+    }
+    return node;
+}
+
+//the cached tree of `source`; nullptr if there's none that this build of the interpreter can use
+ASTNode* load_cached_ast(const string& dir, const string& source) {
+    string path = ast_cache_path(dir, source);
+    if(access(path.c_str(), R_OK) != 0) return nullptr;
+    try {
+        BinReader reader = { make_shared<MappedFile>(path), 0 };
+        if(memcmp(reader.take(8), AST_CACHE_MAGIC, 8) != 0) return nullptr;
+        uint32_t header[2];
+        memcpy(header, reader.take(8), 8);
+        if(header[0] != AST_CACHE_VERSION || header[1] != BIN_BYTE_ORDER) return nullptr;
+        if(reader.u64() != ast_cache_build_stamp()) return nullptr;
+        size_t len = reader.u64();
+        if(len != source.size() || memcmp(reader.take(len), source.data(), len) != 0) return nullptr;
+        reader.take((8 - len % 8) % 8);
+        uint64_t nodes_size = reader.u64();
+        uint64_t nodes_hash = reader.u64();
+        const char* nodes = reader.take(nodes_size);
+        if(hash_bytes(nodes, nodes_size) != nodes_hash) return nullptr;
+        size_t nodes_end = reader.pos;
+        reader.pos -= nodes_size;
+        ASTNode* root = read_ast(reader);
+        if(reader.pos != nodes_end) {
+            delete_ast(root);
+            return nullptr;
+        }
+        return root;
+    } catch(RRError&) {
+        return nullptr; //unreadable or corrupt; it gets parsed, and written again
+    }
+}
+
+//save the tree `root` of `source`; written to a temporary file first, so other runs never see half a file
+void save_cached_ast(const string& dir, const string& source, ASTNode* root) {
+    mkdir(dir.c_str(), 0755);
+    string path = ast_cache_path(dir, source);
+    string tmp_path = path + "." + to_string(getpid()) + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if(file == nullptr) {
+        fprintf(stderr, "--cache: cannot write to '%s'\n", dir.c_str());
+        return;
+    }
+    BinWriter writer = { file, tmp_path };
+    bool written = true;
+    //the nodes are written to memory first, since their hash goes before them
+    char* nodes = nullptr;
+    size_t nodes_size = 0;
+    FILE* nodes_file = open_memstream(&nodes, &nodes_size);
+    try {
+        if(nodes_file == nullptr) rr_runtime_error("Couldn't write to memory");
+        BinWriter nodes_writer = { nodes_file, tmp_path };
+        write_ast(nodes_writer, root);
+        if(fclose(nodes_file) != 0) rr_runtime_error("Couldn't write to memory");
+        nodes_file = nullptr;
+        writer.bytes(AST_CACHE_MAGIC, 8);
+        uint32_t header[2] = {AST_CACHE_VERSION, BIN_BYTE_ORDER};
+        writer.bytes(header, 8);
+        writer.u64(ast_cache_build_stamp());
+        writer.str(source);
+        writer.u64(nodes_size);
+        writer.u64(hash_bytes(nodes, nodes_size));
+        writer.bytes(nodes, nodes_size);
+    } catch(RRError&) {
+        written = false;
+    }
+    if(nodes_file != nullptr) fclose(nodes_file);
+    free(nodes);
+    if(fclose(file) != 0) written = false;
+    if(!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        fprintf(stderr, "--cache: cannot write to '%s'\n", dir.c_str());
+    }
+}
@@ -5,11 +5,60 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <cmath>
+#include <charconv>
 
 #include "datatypes.h"
 #include "tokenizer.h"
 #include "rr_obj.h"
 #include "environment.h"
+#include "rr_vec.h"
+#include "csv.h"
+#include "rr_binary.h"
+#include "group_by.h"
+#include "sort.h"
+#include "linalg.h"
+#include "random.h"
+#include "vec_fusion.h"
+#include "vec_jit.h"
+
+//evaluate an `Expr` given to a lazy parameter; defined in parser.h, where ASTNode is complete
+RRObj eval_expr(RRObj& expr, Env& env);
+
+/*
+    string building helpers
+    the final size is known before anything is copied, so every result string is allocated once
+*/
+
+//number of chars in the string form of `num`
+size_t int_str_len(long long num) {
+    size_t len = num < 0 ? 2 : 1;
+    unsigned long long n = num < 0 ? 0ULL - (unsigned long long) num : num;
+    while(n >= 10) {
+        n /= 10;
+        len++;
+    }
+    return len;
+}
+
+//append the string form of `num` to `str`, without a temporary string
+void append_int(string& str, long long num) {
+    size_t at = str.size();
+    str.resize(at + int_str_len(num));
+    to_chars(&str[at], &str[0] + str.size(), num);
+}
+
+//number of chars `obj` adds to a built string; only str/int are supported
+size_t str_len_of(const RRObj& obj, const RRDataType& str_type, const RRDataType& int_type) {
+    if(obj.type == str_type) return obj.data_str->size();
+    if(obj.type == int_type) return int_str_len(obj.data_int);
+    return 0;
+}
+
+//append str/int `obj` to `str`; ignore other types
+void append_obj(string& str, const RRObj& obj, const RRDataType& str_type, const RRDataType& int_type) {
+    if(obj.type == str_type) str += *obj.data_str;
+    else if(obj.type == int_type) append_int(str, obj.data_int);
+}
 
 /*
     add operators
@@ -42,15 +91,30 @@ RRObj int_add_float(vector<RRObj>& args, Env& env) {
 
 // str/str `+` operator
 RRObj str_add_str(vector<RRObj>& args, Env& env) {
+    if(args[0].owner) {
+        //left side is a temporary (`a + b + c`), so append to it in place
+        *(args[0].data_str) += *(args[1].data_str);
+        return args[0].move();
+    }
     RRObj new_str = RRObj(RRDataType("Str"));
-    new_str.data_str = new string(*(args[0].data_str) + *(args[1].data_str));
+    new_str.data_str = new string();
+    new_str.data_str->reserve(args[0].data_str->size() + args[1].data_str->size());
+    *(new_str.data_str) += *(args[0].data_str);
+    *(new_str.data_str) += *(args[1].data_str);
     return new_str.move();
 }
 
 // str/int `+` operator
 RRObj str_add_int(vector<RRObj>& args, Env& env) {
+    if(args[0].owner) {
+        append_int(*(args[0].data_str), args[1].data_int);
+        return args[0].move();
+    }
     RRObj new_str = RRObj(RRDataType("Str"));
-    new_str.data_str = new string(*(args[0].data_str) + to_string(args[1].data_int));
+    new_str.data_str = new string();
+    new_str.data_str->reserve(args[0].data_str->size() + int_str_len(args[1].data_int));
+    *(new_str.data_str) += *(args[0].data_str);
+    append_int(*(new_str.data_str), args[1].data_int);
     return new_str.move();
 }
 
@@ -62,10 +126,21 @@ RRObj int_multiply_int(vector<RRObj>& args, Env& env) {
 
 // str/int `repeat` operator
 RRObj str_repeat_int(vector<RRObj>& args, Env& env) {
+    string& piece = *(args[0].data_str);
+    size_t times = args[1].data_int > 0 ? args[1].data_int : 0;
+    size_t total = piece.size() * times;
     RRObj new_str = RRObj(RRDataType("Str"));
-    new_str.data_str = new string();
-    for(int i = 0; i < args[1].data_int; i++)
-        *(new_str.data_str) += *(args[0].data_str);
+    new_str.data_str = new string(total, '\0');
+    if(total == 0) return new_str.move();
+    //copy the piece once, then keep doubling what's already been written
+    char* data = &(*new_str.data_str)[0];
+    memcpy(data, piece.data(), piece.size());
+    size_t filled = piece.size();
+    while(filled < total) {
+        size_t chunk = min(filled, total - filled);
+        memcpy(data + filled, data, chunk);
+        filled += chunk;
+    }
     return new_str.move();
 }
 
@@ -89,49 +164,951 @@ RRObj int_eq_int(vector<RRObj>& args, Env& env) {
     return comp_res;
 }
 
+// bool/expr `&&` operator; right side is only evaluated when left side is true
+RRObj bool_and_expr(vector<RRObj>& args, Env& env) {
+    if(!args[0].data_bool) return args[0];
+    RRObj rhs = eval_expr(args[1], env);
+    if(!(rhs.type == RRDataType("Bool"))) rr_runtime_error("Right side of '&&' is not a Bool");
+    return rhs;
+}
+
+// bool/expr `||` operator; right side is only evaluated when left side is false
+RRObj bool_or_expr(vector<RRObj>& args, Env& env) {
+    if(args[0].data_bool) return args[0];
+    RRObj rhs = eval_expr(args[1], env);
+    if(!(rhs.type == RRDataType("Bool"))) rr_runtime_error("Right side of '||' is not a Bool");
+    return rhs;
+}
+
+// any/expr `??` operator; right side is only evaluated when left side is None
+RRObj any_coalesce_expr(vector<RRObj>& args, Env& env) {
+    if(args[0].type == RRDataType("None")) return eval_expr(args[1], env);
+    return args[0];
+}
+
 // any `print` function
 RRObj print_any(vector<RRObj>& args, Env& env) {
-    cout << args[0] << endl;
+    rr_out << args[0] << '\n';
     return args[0];
 }
 
+// list/vec `print_each` function; print every element on its own line
+RRObj print_each_list(vector<RRObj>& args, Env& env) {
+    vector<RRObj>& vec = *args[0].data_list;
+    for(int i = 0; i < vec.size(); i++) {
+        rr_out << vec[i] << '\n';
+    }
+    return args[0];
+}
+
+// list_view `print_each` function
+RRObj print_each_list_view(vector<RRObj>& args, Env& env) {
+    RRListView* view = args[0].data_view;
+    for(long long i = 0; i < view->len; i++) {
+        rr_out << view->at(i) << '\n';
+    }
+    return args[0];
+}
+
+// `flush` function; write out everything printed so far
+RRObj flush_output(vector<RRObj>& args, Env& env) {
+    rr_out.flush();
+    return RRObj();
+}
+
 // list<str/int>/string `concat` function; concatinate all items in the list with string as delimiter
 RRObj concat_list_str(vector<RRObj>& args, Env& env) {
-    vector<RRObj>* vec = args[0].data_list;
-    string glue = *args[1].data_str;
+    vector<RRObj>& vec = *args[0].data_list;
+    string& glue = *args[1].data_str;
+    RRDataType str_type = RRDataType("Str");
+    RRDataType int_type = RRDataType("Int");
+    //first pass - final size; non-str/int elements are ignored, but still get glue
+    size_t size = vec.size() > 0 ? glue.size() * (vec.size() - 1) : 0;
+    for(int i = 0; i < vec.size(); i++) {
+        size += str_len_of(vec[i], str_type, int_type);
+    }
+    //second pass - fill
     string* str = new string();
-    //all but last element - with glue
-    for(int i = 0; i < vec->size()-1; i++) {
-        RRObj obj = (*vec)[i];
-        if(obj.type == RRDataType("Str"))
-            (*str) += *obj.data_str;
-        else if(obj.type == RRDataType("Int"))
-            (*str) += to_string(obj.data_int);
-        //ignore non-str/int because it's not even final, i don't really care
-        (*str) += glue;
-    }
-    //last list element - without glue
-    RRObj obj = (*vec)[vec->size()-1];
-    if(obj.type == RRDataType("Str"))
-        (*str) += *obj.data_str;
-    else if(obj.type == RRDataType("Int"))
-        (*str) += to_string(obj.data_int);
+    str->reserve(size);
+    for(int i = 0; i < vec.size(); i++) {
+        if(i != 0) (*str) += glue;
+        append_obj(*str, vec[i], str_type, int_type);
+    }
     RRObj to_return(RRDataType("Str"));
     to_return.data_str = str;
     return to_return.move();
 }
 
+/*
+    memory use
+    sizes of values are the heap bytes they hold; values inside Lists are counted as their own type
+*/
+
+// `mem` function; resident memory of the interpreter, in bytes
+RRObj mem(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = current_rss_bytes();
+    return res;
+}
+
+//heap bytes of the characters of `str`, if they don't fit in the string itself
+long long str_heap_bytes(const string& str) {
+    return str.capacity() > 15 ? str.capacity() + 1 : 0;
+}
+
+long long vec_heap_bytes(const RRVec& vec) {
+    long long bytes = sizeof(RRVec) + vec.ints.capacity() * sizeof(long long) + vec.floats.capacity() * sizeof(double);
+    bytes += vec.strs.capacity() * sizeof(string);
+    for(size_t i = 0; i < vec.strs.size(); i++) bytes += str_heap_bytes(vec.strs[i]);
+    return bytes; //a mapped Vec's elements are in the file, not on the heap
+}
+
+//add `obj` and all values inside it to `rows`, which has a row for every type
+void value_memory(const RRObj& obj, vector<MemRow>& rows) {
+    if(!obj.owner) return; //the value it refers to is counted by its owner
+    long long bytes = 0;
+    if(obj.type == RRDataType("Str") || obj.type == RRDataType("StrBuilder")) {
+        bytes = sizeof(string) + str_heap_bytes(*obj.data_str);
+    } else if(obj.type == RRDataType("List")) {
+        bytes = sizeof(vector<RRObj>) + obj.data_list->capacity() * sizeof(RRObj);
+        for(int i = 0; i < obj.data_list->size(); i++) value_memory((*obj.data_list)[i], rows);
+    } else if(obj.type == RRDataType("Vec")) {
+        bytes = vec_heap_bytes(*obj.data_vec);
+    } else if(obj.type == RRDataType("DataFrame")) {
+        RRDataFrame& frame = *obj.data_frame;
+        bytes = sizeof(RRDataFrame) + frame.names.capacity() * sizeof(string) + frame.columns.capacity() * sizeof(RRVec*);
+        for(int i = 0; i < frame.columns.size(); i++) {
+            bytes += str_heap_bytes(frame.names[i]);
+            if(frame.columns[i] != nullptr) bytes += vec_heap_bytes(*frame.columns[i]);
+        }
+    } else if(obj.type == RRDataType("Matrix")) {
+        bytes = sizeof(RRMatrix) + obj.data_matrix->data.capacity() * sizeof(double);
+    } else if(obj.type == RRDataType("Slice")) {
+        bytes = sizeof(RRSlice);
+    } else if(obj.type == RRDataType("ListView")) {
+        bytes = sizeof(RRListView);
+    }
+    rows[obj.type.type].count++;
+    rows[obj.type.type].bytes += bytes;
+}
+
+/*
+    StrBuilder functions
+    a StrBuilder is appended to in place, so building a string in a loop is amortised O(1) per append
+*/
+
+// `StrBuilder` function; make an empty builder
+RRObj new_str_builder(vector<RRObj>& args, Env& env) {
+    RRObj builder = RRObj(RRDataType("StrBuilder"));
+    builder.data_str = new string();
+    return builder.move();
+}
+
+// str `StrBuilder` function; make a builder starting with the given string
+RRObj str_builder_from_str(vector<RRObj>& args, Env& env) {
+    RRObj builder = RRObj(RRDataType("StrBuilder"));
+    builder.data_str = new string(*args[0].data_str);
+    return builder.move();
+}
+
+// str_builder/str `append` function
+RRObj str_builder_append_str(vector<RRObj>& args, Env& env) {
+    *(args[0].data_str) += *(args[1].data_str);
+    return args[0];
+}
+
+// str_builder/int `append` function
+RRObj str_builder_append_int(vector<RRObj>& args, Env& env) {
+    append_int(*(args[0].data_str), args[1].data_int);
+    return args[0];
+}
+
+// str_builder `Str` function; get the built string
+RRObj str_from_str_builder(vector<RRObj>& args, Env& env) {
+    RRObj new_str = RRObj(RRDataType("Str"));
+    new_str.data_str = new string(*args[0].data_str);
+    return new_str.move();
+}
+
+/*
+    slices and views
+    indexing by a slice or a list gives a ListView, which shares the elements of the indexed List
+*/
+
+// int/int `:` operator; make a slice `start:stop`
+RRObj int_slice_int(vector<RRObj>& args, Env& env) {
+    RRObj slice = RRObj(RRDataType("Slice"));
+    slice.data_slice = new RRSlice { args[0].data_int, args[1].data_int, 1 };
+    return slice.move();
+}
+
+// slice/int `:` operator; set the step of a slice, `start:stop:step`
+RRObj slice_step_int(vector<RRObj>& args, Env& env) {
+    if(args[1].data_int <= 0) rr_runtime_error("Slice step must be positive");
+    if(args[0].owner) {
+        args[0].data_slice->step = args[1].data_int;
+        return args[0].move();
+    }
+    RRObj slice = RRObj(RRDataType("Slice"));
+    slice.data_slice = new RRSlice { args[0].data_slice->start, args[0].data_slice->stop, args[1].data_int };
+    return slice.move();
+}
+
+//clamp `slice` to a collection of `size` elements; return the first selected index and set `len`
+long long clamp_slice(RRSlice& slice, long long size, long long& len) {
+    long long start = min(max(slice.start, 0LL), size);
+    long long stop = min(max(slice.stop, 0LL), size);
+    len = start < stop ? (stop - start + slice.step - 1) / slice.step : 0;
+    return start;
+}
+
+//check that every element of `indices` is an Int in range of a collection of `size` elements
+void check_indices(vector<RRObj>& indices, long long size) {
+    RRDataType int_type = RRDataType("Int");
+    for(int i = 0; i < indices.size(); i++) {
+        if(!(indices[i].type == int_type)) rr_runtime_error("Indexing with a list of non-Int elements");
+        if(indices[i].data_int < 0 || indices[i].data_int >= size) rr_runtime_error("Index out of range: "s + to_string(indices[i].data_int));
+    }
+}
+
+//make a view of the whole List `list`; a temporary list is kept alive by the view instead
+RRListView* view_of(RRObj& list) {
+    RRListView* view = new RRListView { list.data_list, list.owner, nullptr, false, 0, 1, (long long) list.data_list->size() };
+    list.owner = false;
+    return view;
+}
+
+//make an empty view of the same parent as `from`; a temporary `from` hands its parent over to the new view
+RRListView* view_of_parent(RRObj& from) {
+    RRListView* old_view = from.data_view;
+    RRListView* view = new RRListView { old_view->parent, false, nullptr, false, 0, 1, 0 };
+    if(from.owner && old_view->owns_parent) {
+        view->owns_parent = true;
+        old_view->owns_parent = false;
+    }
+    return view;
+}
+
+RRObj view_obj(RRListView* view) {
+    RRObj obj = RRObj(RRDataType("ListView"));
+    obj.data_view = view;
+    return obj.move();
+}
+
 // list[int] index
 RRObj list_int_index(vector<RRObj>& args, Env& env) {
+    if(args[1].data_int < 0 || args[1].data_int >= args[0].data_list->size()) rr_runtime_error("Index out of range: "s + to_string(args[1].data_int));
     return (*args[0].data_list)[args[1].data_int];
 }
 
-// list[list] index
+// list[list] index; gives a view of the selected elements
 RRObj list_list_index(vector<RRObj>& args, Env& env) {
-    RRObj answer_list = RRObj(new vector<RRObj>());
-    vector<RRObj> index_args = (*args[1].data_list);
-    for(int i = 0; i < index_args.size(); i++) {
-        answer_list.data_list->push_back((*args[0].data_list)[index_args[i].data_int]);
+    check_indices(*args[1].data_list, args[0].data_list->size());
+    RRListView* view = view_of(args[0]);
+    view->indices = args[1].data_list;
+    view->owns_indices = args[1].owner;
+    args[1].owner = false;
+    view->len = view->indices->size();
+    return view_obj(view);
+}
+
+// list[slice] index; gives a view of the selected elements
+RRObj list_slice_index(vector<RRObj>& args, Env& env) {
+    RRListView* view = view_of(args[0]);
+    view->step = args[1].data_slice->step;
+    view->start = clamp_slice(*args[1].data_slice, view->parent->size(), view->len);
+    return view_obj(view);
+}
+
+// list_view[int] index
+RRObj list_view_int_index(vector<RRObj>& args, Env& env) {
+    RRListView* view = args[0].data_view;
+    if(args[1].data_int < 0 || args[1].data_int >= view->len) rr_runtime_error("Index out of range: "s + to_string(args[1].data_int));
+    return view->at(args[1].data_int);
+}
+
+// list_view[list] index; gives a view of the same parent
+RRObj list_view_list_index(vector<RRObj>& args, Env& env) {
+    RRListView* old_view = args[0].data_view;
+    vector<RRObj>& indices = *args[1].data_list;
+    check_indices(indices, old_view->len);
+    RRListView* view = view_of_parent(args[0]);
+    view->indices = new vector<RRObj>();
+    view->indices->reserve(indices.size());
+    view->owns_indices = true;
+    for(int i = 0; i < indices.size(); i++) {
+        RRObj index = RRObj(RRDataType("Int"));
+        index.data_int = old_view->parent_index(indices[i].data_int);
+        view->indices->push_back(index);
+    }
+    view->len = indices.size();
+    return view_obj(view);
+}
+
+// list_view[slice] index; gives a view of the same parent
+RRObj list_view_slice_index(vector<RRObj>& args, Env& env) {
+    RRListView* old_view = args[0].data_view;
+    RRSlice& slice = *args[1].data_slice;
+    RRListView* view = view_of_parent(args[0]);
+    long long start = clamp_slice(slice, old_view->len, view->len);
+    if(old_view->indices == nullptr) {
+        //slice of a slice is still a slice
+        view->start = old_view->start + start * old_view->step;
+        view->step = old_view->step * slice.step;
+    } else {
+        view->indices = new vector<RRObj>();
+        view->indices->reserve(view->len);
+        view->owns_indices = true;
+        for(long long i = 0; i < view->len; i++) {
+            RRObj index = RRObj(RRDataType("Int"));
+            index.data_int = old_view->parent_index(start + i * slice.step);
+            view->indices->push_back(index);
+        }
+    }
+    return view_obj(view);
+}
+
+/*
+    reductions
+    they read views in place, so `sum(l[a:b])` doesn't copy anything
+*/
+
+//sum of the Int/Float elements of `view`; Int if all elements are Int
+RRObj sum_of(RRListView& view) {
+    RRDataType int_type = RRDataType("Int");
+    RRDataType float_type = RRDataType("Float");
+    long long int_sum = 0;
+    double float_sum = 0;
+    bool is_float = false;
+    for(long long i = 0; i < view.len; i++) {
+        RRObj& obj = view.at(i);
+        if(obj.type == int_type) int_sum += obj.data_int;
+        else if(obj.type == float_type) {
+            float_sum += obj.data_float;
+            is_float = true;
+        } else rr_runtime_error("Cannot sum a list with non-Int/Float elements");
+    }
+    if(is_float) {
+        RRObj res = RRObj(float_type);
+        res.data_float = float_sum + (double) int_sum;
+        return res;
+    }
+    RRObj res = RRObj(int_type);
+    res.data_int = int_sum;
+    return res;
+}
+
+// list `sum` function
+RRObj sum_list(vector<RRObj>& args, Env& env) {
+    RRListView whole = { args[0].data_list, false, nullptr, false, 0, 1, (long long) args[0].data_list->size() };
+    return sum_of(whole);
+}
+
+// list_view `sum` function
+RRObj sum_list_view(vector<RRObj>& args, Env& env) {
+    return sum_of(*args[0].data_view);
+}
+
+// list `len` function
+RRObj len_list(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_list->size();
+    return res;
+}
+
+// list_view `len` function
+RRObj len_list_view(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_view->len;
+    return res;
+}
+
+// str `len` function
+RRObj len_str(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_str->size();
+    return res;
+}
+
+/*
+    Vec and DataFrame functions
+*/
+
+//element `i` of `vec` as an object
+RRObj vec_elem(RRVec& vec, size_t i) {
+    RRObj obj = RRObj(vec.elem);
+    if(vec.holds_floats()) obj.data_float = vec.float_data()[i];
+    else if(vec.holds_strs()) obj.data_str = new string(vec.strs[i]);
+    else if(vec.elem == RRDataType("Bool")) obj.data_bool = vec.int_data()[i];
+    else obj.data_int = vec.int_data()[i];
+    return obj;
+}
+
+// list `Vec` function; pack a list of Int/Float/Bool/Str elements of the same type
+RRObj vec_from_list(vector<RRObj>& args, Env& env) {
+    vector<RRObj>& list = *args[0].data_list;
+    RRVec* vec = new RRVec(list.empty() ? RRDataType() : list[0].type);
+    RRDataType elem = vec->elem;
+    for(int i = 0; i < list.size(); i++) {
+        if(!(list[i].type == elem)) rr_runtime_error("Vec elements must all be of the same type");
+    }
+    if(elem == RRDataType("Int")) {
+        vec->ints.reserve(list.size());
+        for(int i = 0; i < list.size(); i++) vec->ints.push_back(list[i].data_int);
+    } else if(elem == RRDataType("Bool")) {
+        vec->ints.reserve(list.size());
+        for(int i = 0; i < list.size(); i++) vec->ints.push_back(list[i].data_bool);
+    } else if(elem == RRDataType("Float")) {
+        vec->floats.reserve(list.size());
+        for(int i = 0; i < list.size(); i++) vec->floats.push_back(list[i].data_float);
+    } else if(elem == RRDataType("Str")) {
+        vec->strs.reserve(list.size());
+        for(int i = 0; i < list.size(); i++) vec->strs.push_back(*list[i].data_str);
+    } else if(!list.empty()) {
+        rr_runtime_error("Vec can only hold Int, Float, Bool or Str elements");
+    }
+    RRObj obj = RRObj(RRDataType("Vec"));
+    obj.data_vec = vec;
+    return obj.move();
+}
+
+// vec `List` function
+RRObj list_from_vec(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    RRObj list = RRObj(new vector<RRObj>());
+    list.data_list->reserve(vec.size());
+    for(size_t i = 0; i < vec.size(); i++) {
+        list.data_list->push_back(vec_elem(vec, i));
+    }
+    return list.move();
+}
+
+// vec[int] index
+RRObj vec_int_index(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    if(args[1].data_int < 0 || args[1].data_int >= vec.size()) rr_runtime_error("Index out of range: "s + to_string(args[1].data_int));
+    return vec_elem(vec, args[1].data_int);
+}
+
+// vec `len` function
+RRObj len_vec(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_vec->size();
+    return res;
+}
+
+// vec `sum` function; Int for Int/Bool elements, Float for Float elements
+RRObj sum_vec(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    if(vec.holds_strs()) rr_runtime_error("Cannot sum a Vec of Str");
+    size_t len = vec.size();
+    if(vec.holds_floats()) {
+        const double* floats = vec.float_data();
+        RRObj res = RRObj(RRDataType("Float"));
+        res.data_float = 0;
+        for(size_t i = 0; i < len; i++) res.data_float += floats[i];
+        return res;
+    }
+    const long long* ints = vec.int_data();
+    RRObj res = RRObj(RRDataType("Int"));
+    for(size_t i = 0; i < len; i++) res.data_int += ints[i];
+    return res;
+}
+
+// vec `print_each` function
+RRObj print_each_vec(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    for(size_t i = 0; i < vec.size(); i++) {
+        rr_out << vec_elem(vec, i) << '\n';
+    }
+    return args[0];
+}
+
+// str `read_csv` function; read a CSV file with a header line into a DataFrame
+RRObj read_csv_str(vector<RRObj>& args, Env& env) {
+    RRObj frame = RRObj(RRDataType("DataFrame"));
+    frame.data_frame = read_csv_file(*args[0].data_str);
+    return frame.move();
+}
+
+//column `col` of the DataFrame `frame_obj`, as a Vec
+//a temporary frame gives the column away, so `read_csv(path)["col"]` doesn't copy it
+RRObj frame_column(RRObj& frame_obj, int col) {
+    RRDataFrame* frame = frame_obj.data_frame;
+    if(col < 0 || col >= frame->columns.size()) rr_runtime_error("Column index out of range: "s + to_string(col));
+    RRObj column = RRObj(RRDataType("Vec"));
+    column.data_vec = frame->columns[col];
+    if(frame_obj.owner) {
+        frame->columns[col] = nullptr;
+    } else {
+        column.owner = false;
+    }
+    return column;
+}
+
+// dataframe[str] index; get a column by name
+RRObj frame_str_index(vector<RRObj>& args, Env& env) {
+    int col = args[0].data_frame->column_of(*args[1].data_str);
+    if(col < 0) rr_runtime_error("DataFrame has no column '"s + *args[1].data_str + "'");
+    return frame_column(args[0], col);
+}
+
+// dataframe[int] index; get a column by position
+RRObj frame_int_index(vector<RRObj>& args, Env& env) {
+    return frame_column(args[0], args[1].data_int);
+}
+
+// dataframe `nrow` function
+RRObj nrow_frame(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_frame->rows();
+    return res;
+}
+
+// dataframe `ncol` function
+RRObj ncol_frame(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_frame->columns.size();
+    return res;
+}
+
+// dataframe `names` function; list of column names
+RRObj names_frame(vector<RRObj>& args, Env& env) {
+    vector<string>& names = args[0].data_frame->names;
+    RRObj list = RRObj(new vector<RRObj>());
+    for(int i = 0; i < names.size(); i++) {
+        list.data_list->push_back(RRObj(names[i]));
     }
-    return answer_list.move();
-}
\ No newline at end of file
+    return list.move();
+}
+
+// vec, vec, str `group_by` function; aggregate values per key, see group_by.h
+RRObj group_by_vec_vec_str(vector<RRObj>& args, Env& env) {
+    RRObj frame = RRObj(RRDataType("DataFrame"));
+    frame.data_frame = group_by_vec(*args[0].data_vec, *args[1].data_vec, *args[2].data_str);
+    return frame.move();
+}
+
+// dataframe, str, str `group_by` function; aggregate every other column per value of a key column
+RRObj group_by_frame_str_str(vector<RRObj>& args, Env& env) {
+    RRObj frame = RRObj(RRDataType("DataFrame"));
+    frame.data_frame = group_by_frame(*args[0].data_frame, *args[1].data_str, *args[2].data_str);
+    return frame.move();
+}
+
+//a new Vec object holding `vec`
+RRObj vec_obj(RRVec* vec) {
+    RRObj obj = RRObj(RRDataType("Vec"));
+    obj.data_vec = vec;
+    return obj.move();
+}
+
+//a new DataFrame object holding `frame`
+RRObj frame_obj(RRDataFrame* frame) {
+    RRObj obj = RRObj(RRDataType("DataFrame"));
+    obj.data_frame = frame;
+    return obj.move();
+}
+
+//Vec of Int positions `idx`
+RRObj positions_vec(const vector<size_t>& idx) {
+    RRVec* vec = new RRVec(RRDataType("Int"));
+    vec->ints.assign(idx.begin(), idx.end());
+    return vec_obj(vec);
+}
+
+// vec `sort` function; see sort.h
+RRObj sort_vec(vector<RRObj>& args, Env& env) {
+    return vec_obj(vec_sorted(*args[0].data_vec));
+}
+
+// list `sort` function; numbers first, then strings
+RRObj sort_list(vector<RRObj>& args, Env& env) {
+    vector<RRObj>& list = *args[0].data_list;
+    vector<size_t> idx = list_argsort(list);
+    RRObj res = RRObj(new vector<RRObj>());
+    res.data_list->reserve(idx.size());
+    for(size_t i = 0; i < idx.size(); i++) res.data_list->push_back(list[idx[i]]);
+    return res.move();
+}
+
+// dataframe, str `sort` function; sort the rows by a column
+RRObj sort_frame_str(vector<RRObj>& args, Env& env) {
+    return frame_obj(frame_sorted(*args[0].data_frame, *args[1].data_str));
+}
+
+// vec `argsort` function; positions of the elements in sorted order
+RRObj argsort_vec(vector<RRObj>& args, Env& env) {
+    return positions_vec(vec_argsort(*args[0].data_vec));
+}
+
+// list `argsort` function
+RRObj argsort_list(vector<RRObj>& args, Env& env) {
+    return positions_vec(list_argsort(*args[0].data_list));
+}
+
+// vec `unique` function; distinct elements, in the order they first appear
+RRObj unique_vec(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    return vec_obj(group_key_column(vec, group_keys(vec)));
+}
+
+// list `unique` function; distinct elements, in the order they first appear
+RRObj unique_list(vector<RRObj>& args, Env& env) {
+    vector<RRObj>& list = *args[0].data_list;
+    vector<size_t> rows = list_unique_rows(list);
+    RRObj res = RRObj(new vector<RRObj>());
+    res.data_list->reserve(rows.size());
+    for(size_t i = 0; i < rows.size(); i++) res.data_list->push_back(list[rows[i]]);
+    return res.move();
+}
+
+// dataframe `unique` function; distinct rows, in the order they first appear
+RRObj unique_frame(vector<RRObj>& args, Env& env) {
+    return frame_obj(frame_unique(*args[0].data_frame));
+}
+
+// dataframe, dataframe, str `join` function; inner hash join on a column of both
+RRObj join_frame_frame_str(vector<RRObj>& args, Env& env) {
+    return frame_obj(frame_join(*args[0].data_frame, *args[1].data_frame, *args[2].data_str));
+}
+
+//a new Matrix object holding `matrix`
+RRObj matrix_obj(RRMatrix* matrix) {
+    RRObj obj = RRObj(RRDataType("Matrix"));
+    obj.data_matrix = matrix;
+    return obj.move();
+}
+
+//Vec of the Floats in `matrix`, which has a single column
+RRObj column_vec(RRMatrix* matrix) {
+    RRVec* vec = new RRVec(RRDataType("Float"));
+    vec->floats.swap(matrix->data);
+    delete matrix;
+    return vec_obj(vec);
+}
+
+//`vec` of Int/Float/Bool elements, as a single column Matrix
+RRMatrix column_matrix(const RRVec& vec) {
+    if(vec.holds_strs()) rr_runtime_error("Cannot use a Vec of Str as numbers");
+    RRMatrix matrix(vec.size(), 1);
+    if(vec.holds_floats()) copy(vec.float_data(), vec.float_data() + vec.size(), matrix.data.begin());
+    else copy(vec.int_data(), vec.int_data() + vec.size(), matrix.data.begin());
+    return matrix;
+}
+
+// list `Matrix` function; from a List of rows, each a List of Int/Float
+RRObj matrix_from_list(vector<RRObj>& args, Env& env) {
+    vector<RRObj>& rows = *args[0].data_list;
+    RRDataType list_type = RRDataType("List");
+    RRDataType int_type = RRDataType("Int");
+    RRDataType float_type = RRDataType("Float");
+    size_t cols = rows.empty() || !(rows[0].type == list_type) ? 0 : rows[0].data_list->size();
+    RRMatrix* matrix = new RRMatrix(rows.size(), cols);
+    for(size_t i = 0; i < rows.size(); i++) {
+        if(!(rows[i].type == list_type) || rows[i].data_list->size() != cols) {
+            delete matrix;
+            rr_runtime_error("Matrix needs a List of rows, all Lists of the same length");
+        }
+        vector<RRObj>& row = *rows[i].data_list;
+        for(size_t j = 0; j < cols; j++) {
+            if(row[j].type == float_type) matrix->at(i, j) = row[j].data_float;
+            else if(row[j].type == int_type) matrix->at(i, j) = row[j].data_int;
+            else {
+                delete matrix;
+                rr_runtime_error("Matrix elements must be Int or Float");
+            }
+        }
+    }
+    return matrix_obj(matrix);
+}
+
+// vec, int `Matrix` function; fill a Matrix with `int` rows from the Vec, row by row
+RRObj matrix_from_vec_int(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    long long rows = args[1].data_int;
+    if(rows <= 0 || vec.size() % rows != 0) rr_runtime_error("Cannot split "s + to_string(vec.size()) + " elements into " + to_string(rows) + " rows");
+    RRMatrix* matrix = new RRMatrix(column_matrix(vec));
+    matrix->rows = rows;
+    matrix->cols = vec.size() / rows;
+    return matrix_obj(matrix);
+}
+
+// int `diag` function; identity Matrix
+RRObj diag_int(vector<RRObj>& args, Env& env) {
+    if(args[0].data_int < 0) rr_runtime_error("Matrix size can't be negative");
+    return matrix_obj(identity(args[0].data_int));
+}
+
+// matrix %*% matrix operator; see linalg.h
+RRObj matrix_matmul_matrix(vector<RRObj>& args, Env& env) {
+    return matrix_obj(matmul(*args[0].data_matrix, *args[1].data_matrix));
+}
+
+// matrix %*% vec operator; the Vec is a column
+RRObj matrix_matmul_vec(vector<RRObj>& args, Env& env) {
+    return column_vec(matmul(*args[0].data_matrix, column_matrix(*args[1].data_vec)));
+}
+
+// matrix + matrix operator
+RRObj matrix_add_matrix(vector<RRObj>& args, Env& env) {
+    RRMatrix& a = *args[0].data_matrix;
+    RRMatrix& b = *args[1].data_matrix;
+    if(a.rows != b.rows || a.cols != b.cols) rr_runtime_error("Cannot add matrices of different sizes");
+    RRMatrix* res = new RRMatrix(a);
+    for(size_t i = 0; i < b.data.size(); i++) res->data[i] += b.data[i];
+    return matrix_obj(res);
+}
+
+//every element of Matrix `a` times `factor`
+RRObj matrix_scaled(RRMatrix& a, double factor) {
+    RRMatrix* res = new RRMatrix(a);
+    for(size_t i = 0; i < res->data.size(); i++) res->data[i] *= factor;
+    return matrix_obj(res);
+}
+
+// matrix * float operator
+RRObj matrix_multiply_float(vector<RRObj>& args, Env& env) {
+    return matrix_scaled(*args[0].data_matrix, args[1].data_float);
+}
+
+// matrix * int operator
+RRObj matrix_multiply_int(vector<RRObj>& args, Env& env) {
+    return matrix_scaled(*args[0].data_matrix, args[1].data_int);
+}
+
+// matrix `t` function; transpose
+RRObj t_matrix(vector<RRObj>& args, Env& env) {
+    return matrix_obj(transpose(*args[0].data_matrix));
+}
+
+// matrix, matrix `solve` function; x such that a %*% x == b
+RRObj solve_matrix_matrix(vector<RRObj>& args, Env& env) {
+    return matrix_obj(solve(*args[0].data_matrix, *args[1].data_matrix));
+}
+
+// matrix, vec `solve` function
+RRObj solve_matrix_vec(vector<RRObj>& args, Env& env) {
+    return column_vec(solve(*args[0].data_matrix, column_matrix(*args[1].data_vec)));
+}
+
+// matrix `solve` function; inverse
+RRObj solve_matrix(vector<RRObj>& args, Env& env) {
+    RRMatrix& a = *args[0].data_matrix;
+    check_square(a, "solve");
+    RRMatrix* id = identity(a.rows);
+    RRMatrix* inverse = solve(a, *id);
+    delete id;
+    return matrix_obj(inverse);
+}
+
+// matrix `det` function
+RRObj det_matrix(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Float"));
+    res.data_float = determinant(*args[0].data_matrix);
+    return res;
+}
+
+// matrix `chol` function; lower triangular factor
+RRObj chol_matrix(vector<RRObj>& args, Env& env) {
+    return matrix_obj(cholesky(*args[0].data_matrix));
+}
+
+// matrix `lu` function; [L, U, perm], with rows perm of the input == L %*% U
+RRObj lu_matrix(vector<RRObj>& args, Env& env) {
+    RRMatrix& a = *args[0].data_matrix;
+    check_square(a, "lu");
+    RRMatrix* u = new RRMatrix(a);
+    vector<size_t> perm;
+    int sign;
+    if(!lu_decompose(*u, perm, sign)) {
+        delete u;
+        rr_runtime_error("Matrix is singular");
+    }
+    RRMatrix* l = identity(a.rows);
+    for(size_t i = 0; i < a.rows; i++) {
+        for(size_t j = 0; j < i; j++) {
+            l->at(i, j) = u->at(i, j);
+            u->at(i, j) = 0;
+        }
+    }
+    RRObj res = RRObj(new vector<RRObj>());
+    res.data_list->push_back(matrix_obj(l));
+    res.data_list->push_back(matrix_obj(u));
+    res.data_list->push_back(positions_vec(perm));
+    return res.move();
+}
+
+// matrix `qr` function; [Q, R]
+RRObj qr_matrix(vector<RRObj>& args, Env& env) {
+    RRMatrix* q;
+    RRMatrix* r;
+    qr_decompose(*args[0].data_matrix, q, r);
+    RRObj res = RRObj(new vector<RRObj>());
+    res.data_list->push_back(matrix_obj(q));
+    res.data_list->push_back(matrix_obj(r));
+    return res.move();
+}
+
+// matrix `nrow` function
+RRObj nrow_matrix(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_matrix->rows;
+    return res;
+}
+
+// matrix `ncol` function
+RRObj ncol_matrix(vector<RRObj>& args, Env& env) {
+    RRObj res = RRObj(RRDataType("Int"));
+    res.data_int = args[0].data_matrix->cols;
+    return res;
+}
+
+// matrix[int] index; a row, as a Vec
+RRObj matrix_int_index(vector<RRObj>& args, Env& env) {
+    RRMatrix& matrix = *args[0].data_matrix;
+    long long i = args[1].data_int;
+    if(i < 0 || i >= matrix.rows) rr_runtime_error("Index out of range: "s + to_string(i));
+    RRVec* vec = new RRVec(RRDataType("Float"));
+    vec->floats.assign(matrix.row(i), matrix.row(i) + matrix.cols);
+    return vec_obj(vec);
+}
+
+//number of samples asked for; can't be negative
+size_t sample_count(RRObj& n) {
+    if(n.data_int < 0) rr_runtime_error("Cannot draw a negative number of samples");
+    return n.data_int;
+}
+
+// int `set_seed` function; see random.h
+RRObj set_seed_int(vector<RRObj>& args, Env& env) {
+    rr_random.seed(args[0].data_int, 0);
+    return RRObj();
+}
+
+// int, int `set_seed` function; seed and stream number
+RRObj set_seed_int_int(vector<RRObj>& args, Env& env) {
+    rr_random.seed(args[0].data_int, args[1].data_int);
+    return RRObj();
+}
+
+//Vec of `n` uniform Floats in [min, max)
+RRObj uniform_vec(size_t n, double min, double max) {
+    RRVec* vec = new RRVec(RRDataType("Float"));
+    fill_random(vec->floats, n, [=](SampleDraws& draws) { return min + (max - min) * draws.uniform(); });
+    return vec_obj(vec);
+}
+
+// int `runif` function; uniform in [0, 1)
+RRObj runif_int(vector<RRObj>& args, Env& env) {
+    return uniform_vec(sample_count(args[0]), 0, 1);
+}
+
+// int, float, float `runif` function; uniform in [min, max)
+RRObj runif_int_float_float(vector<RRObj>& args, Env& env) {
+    return uniform_vec(sample_count(args[0]), args[1].data_float, args[2].data_float);
+}
+
+//Vec of `n` normal Floats
+RRObj normal_vec(size_t n, double mean, double sd) {
+    if(sd < 0) rr_runtime_error("Standard deviation can't be negative");
+    RRVec* vec = new RRVec(RRDataType("Float"));
+    fill_random(vec->floats, n, [=](SampleDraws& draws) { return mean + sd * sample_normal(draws); });
+    return vec_obj(vec);
+}
+
+// int `rnorm` function; standard normal
+RRObj rnorm_int(vector<RRObj>& args, Env& env) {
+    return normal_vec(sample_count(args[0]), 0, 1);
+}
+
+// int, float, float `rnorm` function; normal with mean and standard deviation
+RRObj rnorm_int_float_float(vector<RRObj>& args, Env& env) {
+    return normal_vec(sample_count(args[0]), args[1].data_float, args[2].data_float);
+}
+
+// int, int, float `rbinom` function; successes out of `size` tries with probability `p`
+RRObj rbinom_int_int_float(vector<RRObj>& args, Env& env) {
+    long long size = args[1].data_int;
+    double p = args[2].data_float;
+    if(size < 0 || !(p >= 0 && p <= 1)) rr_runtime_error("rbinom needs size >= 0 and 0 <= p <= 1");
+    RRVec* vec = new RRVec(RRDataType("Int"));
+    fill_random(vec->ints, sample_count(args[0]), [=](SampleDraws& draws) { return sample_binomial(draws, size, p); });
+    return vec_obj(vec);
+}
+
+//Vec of `n` Poisson Ints with mean `lambda`
+RRObj poisson_vec(size_t n, double lambda) {
+    if(!(lambda >= 0) || isinf(lambda)) rr_runtime_error("rpois needs a finite mean >= 0");
+    RRVec* vec = new RRVec(RRDataType("Int"));
+    fill_random(vec->ints, n, [=](SampleDraws& draws) { return sample_poisson(draws, lambda); });
+    return vec_obj(vec);
+}
+
+// int, float `rpois` function
+RRObj rpois_int_float(vector<RRObj>& args, Env& env) {
+    return poisson_vec(sample_count(args[0]), args[1].data_float);
+}
+
+// int, int `rpois` function
+RRObj rpois_int_int(vector<RRObj>& args, Env& env) {
+    return poisson_vec(sample_count(args[0]), args[1].data_int);
+}
+
+// int, int `sample` function; `size` distinct Ints from [0, n)
+RRObj sample_int_int(vector<RRObj>& args, Env& env) {
+    return positions_vec(random_positions(sample_count(args[0]), sample_count(args[1])));
+}
+
+// vec, int `sample` function; `size` elements of the Vec, without replacement
+RRObj sample_vec_int(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    return vec_obj(vec_gather(vec, random_positions(vec.size(), sample_count(args[1]))));
+}
+
+// vec `shuffle` function; a random permutation
+RRObj shuffle_vec(vector<RRObj>& args, Env& env) {
+    RRVec& vec = *args[0].data_vec;
+    return vec_obj(vec_gather(vec, random_positions(vec.size(), vec.size())));
+}
+
+// list `shuffle` function
+RRObj shuffle_list(vector<RRObj>& args, Env& env) {
+    vector<RRObj>& list = *args[0].data_list;
+    vector<size_t> idx = random_positions(list.size(), list.size());
+    RRObj res = RRObj(new vector<RRObj>());
+    res.data_list->reserve(idx.size());
+    for(size_t i = 0; i < idx.size(); i++) res.data_list->push_back(list[idx[i]]);
+    return res.move();
+}
+
+//`lhs op rhs` elementwise, where at least one of them is a Vec
+RRObj vec_arith(vector<RRObj>& args, FuseOpCode op) {
+    vector<FuseInstr> program = {{FUSE_LEAF, 0}, {FUSE_LEAF, 1}, {op, -1}};
+    size_t len;
+    bool floats;
+    if(!fusable_leaves(args, len, floats)) rr_runtime_error("Vec arithmetic needs Int, Float or Bool elements");
+    return vec_obj(fused_vec(program, args, len, floats));
+}
+
+// vec + vec, vec + int/float, int/float + vec operators; elementwise (chains of `+` and `*` are fused, see vec_fusion.h)
+RRObj vec_add(vector<RRObj>& args, Env& env) {
+    return vec_arith(args, FUSE_ADD);
+}
+
+// vec * vec, vec * int/float, int/float * vec operators; elementwise
+RRObj vec_multiply(vector<RRObj>& args, Env& env) {
+    return vec_arith(args, FUSE_MUL);
+}
+
+// any `save` function; write an object to a binary data file, see rr_binary.h
+RRObj save_any_str(vector<RRObj>& args, Env& env) {
+    save_obj(args[0], *args[1].data_str);
+    return RRObj();
+}
+
+// str `load` function; read an object saved with `save`
+//numeric Vec columns stay in the mapped file and are only read from disk when used
+RRObj load_str(vector<RRObj>& args, Env& env) {
+    return load_obj(*args[0].data_str);
+}
@@ -0,0 +1,235 @@
+// Read a CSV file into a DataFrame
+// The first line holds column names. Fields may be quoted (`""` is an escaped quote), but can't contain newlines.
+// Column types are inferred: Int if every field is an integer, else Float if every field is a number, else Str.
+// Empty fields don't affect the type; they are read as 0 (Int), NaN (Float) or "" (Str).
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "datatypes.h"
+#include "rr_vec.h"
+#include "mapped_file.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//files are split into at most one chunk per thread, but no chunk is smaller than this
+const size_t CSV_MIN_CHUNK = 1 << 20;
+
+//column types, from the narrowest to the widest
+enum CsvColType {
+    CSV_INT,
+    CSV_FLOAT,
+    CSV_STR
+};
+
+/*
+    Functions
+*/
+
+//return the first `,` or `\n` in [p, end), or `end`
+const char* csv_find_delim(const char* p, const char* end) {
+#ifdef __SSE2__
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while(end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, newline)));
+        if(mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while(p < end && *p != ',' && *p != '\n') p++;
+    return p;
+}
+
+//read the field starting at `p`; its text is [b, e)
+//return where the next field starts; `last` is set when the field ends its line
+const char* csv_read_field(const char* p, const char* end, const char*& b, const char*& e, bool& last) {
+    b = p;
+    if(p < end && *p == '"') {
+        //skip to the closing quote, so delimiters inside quotes are ignored
+        p++;
+        while(p < end) {
+            const char* quote = (const char*) memchr(p, '"', end - p);
+            if(quote == nullptr) {
+                p = end;
+            } else if(quote + 1 < end && quote[1] == '"') {
+                p = quote + 2;
+                continue;
+            } else {
+                p = quote + 1;
+            }
+            break;
+        }
+    }
+    p = csv_find_delim(p, end);
+    e = p;
+    if(e > b && e[-1] == '\r') e--;
+    last = p >= end || *p == '\n';
+    return p < end ? p + 1 : p;
+}
+
+//skip an empty line at `p`, if there is one
+bool csv_skip_empty_line(const char*& p, const char* end) {
+    if(*p == '\n') {
+        p++;
+        return true;
+    }
+    if(*p == '\r' && p + 1 < end && p[1] == '\n') {
+        p += 2;
+        return true;
+    }
+    return false;
+}
+
+//the narrowest type that can hold field [b, e)
+CsvColType csv_field_type(const char* b, const char* e) {
+    if(b == e) return CSV_INT;
+    if(*b == '"') return CSV_STR;
+    long long int_val;
+    auto int_res = from_chars(b, e, int_val);
+    if(int_res.ec == errc() && int_res.ptr == e) return CSV_INT;
+    double float_val;
+    auto float_res = from_chars(b, e, float_val);
+    if(float_res.ec == errc() && float_res.ptr == e) return CSV_FLOAT;
+    return CSV_STR;
+}
+
+//field [b, e) as a string, without quotes
+string csv_field_str(const char* b, const char* e) {
+    if(e - b < 2 || *b != '"') return string(b, e);
+    string str;
+    str.reserve(e - b - 2);
+    for(const char* p = b + 1; p < e - 1; p++) {
+        str += *p;
+        if(*p == '"' && p + 1 < e - 1 && p[1] == '"') p++;
+    }
+    return str;
+}
+
+//first pass over a chunk of whole lines: count rows and widen `types` to fit every field
+void csv_scan_chunk(const char* p, const char* end, vector<CsvColType>& types, size_t& rows) {
+    const char* b;
+    const char* e;
+    rows = 0;
+    while(p < end) {
+        if(csv_skip_empty_line(p, end)) continue;
+        bool last = false;
+        for(int col = 0; !last; col++) {
+            p = csv_read_field(p, end, b, e, last);
+            if(col < types.size() && types[col] != CSV_STR) types[col] = max(types[col], csv_field_type(b, e));
+        }
+        rows++;
+    }
+}
+
+//second pass over a chunk: parse every field straight into its column, starting at row `row`
+void csv_parse_chunk(const char* p, const char* end, vector<CsvColType>& types, vector<RRVec*>& columns, size_t row) {
+    const char* b;
+    const char* e;
+    while(p < end) {
+        if(csv_skip_empty_line(p, end)) continue;
+        bool last = false;
+        int col = 0;
+        for(; !last; col++) {
+            p = csv_read_field(p, end, b, e, last);
+            if(col >= types.size() || b == e) continue; //extra fields are ignored; empty fields keep the default
+            switch(types[col]) {
+                case CSV_INT: from_chars(b, e, columns[col]->ints[row]); break;
+                case CSV_FLOAT: from_chars(b, e, columns[col]->floats[row]); break;
+                case CSV_STR: columns[col]->strs[row] = csv_field_str(b, e); break;
+            }
+        }
+        row++;
+    }
+}
+
+//read CSV file `path` into a new DataFrame
+//the file is split into chunks of whole lines, which are scanned and then parsed in parallel
+RRDataFrame* read_csv_file(const string& path) {
+    MappedFile file(path);
+    const char* p = file.data;
+    const char* end = file.data + file.size;
+    if(file.size == 0) rr_runtime_error("CSV file '"s + path + "' is empty");
+
+    //header
+    RRDataFrame* frame = new RRDataFrame();
+    const char* b;
+    const char* e;
+    bool last = false;
+    while(!last) {
+        p = csv_read_field(p, end, b, e, last);
+        frame->names.push_back(csv_field_str(b, e));
+    }
+    int ncols = frame->names.size();
+
+    //split the body into chunks that end on line boundaries
+    size_t body_size = end - p;
+    size_t nchunks = max((size_t) 1, min((size_t) thread::hardware_concurrency(), body_size / CSV_MIN_CHUNK));
+    vector<const char*> bounds = {p};
+    for(size_t i = 1; i < nchunks; i++) {
+        const char* at = max(p + body_size * i / nchunks, bounds.back());
+        const char* newline = (const char*) memchr(at, '\n', end - at);
+        bounds.push_back(newline == nullptr ? end : newline + 1);
+    }
+    bounds.push_back(end);
+
+    //first pass: types and row counts
+    vector<vector<CsvColType>> chunk_types(nchunks, vector<CsvColType>(ncols, CSV_INT));
+    vector<size_t> chunk_rows(nchunks);
+    vector<thread> workers;
+    for(size_t i = 0; i < nchunks; i++) {
+        workers.push_back(thread(csv_scan_chunk, bounds[i], bounds[i+1], ref(chunk_types[i]), ref(chunk_rows[i])));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    vector<CsvColType> types(ncols, CSV_INT);
+    vector<size_t> chunk_start(nchunks);
+    size_t rows = 0;
+    for(size_t i = 0; i < nchunks; i++) {
+        for(int col = 0; col < ncols; col++) types[col] = max(types[col], chunk_types[i][col]);
+        chunk_start[i] = rows;
+        rows += chunk_rows[i];
+    }
+
+    //allocate every column once, then fill them in place
+    for(int col = 0; col < ncols; col++) {
+        switch(types[col]) {
+            case CSV_INT: {
+                frame->columns.push_back(new RRVec(RRDataType("Int")));
+                frame->columns.back()->ints.resize(rows, 0);
+            }; break;
+            case CSV_FLOAT: {
+                frame->columns.push_back(new RRVec(RRDataType("Float")));
+                frame->columns.back()->floats.resize(rows, NAN);
+            }; break;
+            case CSV_STR: {
+                frame->columns.push_back(new RRVec(RRDataType("Str")));
+                frame->columns.back()->strs.resize(rows);
+            }; break;
+        }
+    }
+
+    //second pass: parse
+    for(size_t i = 0; i < nchunks; i++) {
+        workers.push_back(thread(csv_parse_chunk, bounds[i], bounds[i+1], ref(types), ref(frame->columns), chunk_start[i]));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+
+    return frame;
+}
@@ -5,12 +5,17 @@
 #include <iostream>
 #include <unordered_map>
 
+#include "tokenizer.h"
+#include "rr_error.h"
+
 using namespace std;
 
 //types stored in place:
 // Int, Float, Bool
 //types stored behind pointers:
-// Str, FnPtr, Vec, Set, Map, List, Pair
+// Str, FnPtr, Vec, Set, Map, List, Pair, StrBuilder, Slice, ListView, DataFrame, Matrix
+//types that are never owned:
+// Expr - an unevaluated AST handle, given to lazy function parameters
 
 /*
     the order is the "importance":
@@ -19,17 +24,33 @@ using namespace std;
     
     while `Any` is not a legal datatype, it may be specified in function singitures
 */
-vector<string> datatypes = {"Bool", "Int", "Float", "Str", "Pair", "Set", "Vec", "Map", "List", "Fn", "None", "Any"};
-vector<int> datatype_template_params = {0,  0,  0,   0,     2,      1,     1,     2,     0,      0,    0,      0 };
+vector<string> datatypes = {"Bool", "Int", "Float", "Str", "Pair", "Set", "Vec", "Map", "List", "Fn", "None", "Expr", "StrBuilder", "Slice", "ListView", "DataFrame", "Matrix", "Any"};
+vector<int> datatype_template_params = {0,  0,  0,   0,     2,      1,     1,     2,     0,      0,    0,      0,      0,            0,       0,          0,           0,        0 };
 unordered_map<string, int> datatypes_num;
 
 const int DATATYPE_ANY = datatypes.size()-1;
 
+//numbers of the types whose values own heap data; every copy and release of a value switches over them,
+// so they're constants instead of being looked up by name (`init_datatypes` checks them against `datatypes`)
+const int DATATYPE_STR = 3;
+const int DATATYPE_VEC = 6;
+const int DATATYPE_LIST = 8;
+const int DATATYPE_STR_BUILDER = 12;
+const int DATATYPE_SLICE = 13;
+const int DATATYPE_LIST_VIEW = 14;
+const int DATATYPE_DATA_FRAME = 15;
+const int DATATYPE_MATRIX = 16;
+
 //call once as part of program setup
 void init_datatypes() {
     for(int i = 0; i < datatypes.size(); i++) {
         datatypes_num[datatypes[i]] = i;
     }
+    if(datatypes[DATATYPE_STR] != "Str" || datatypes[DATATYPE_VEC] != "Vec" || datatypes[DATATYPE_LIST] != "List"
+        || datatypes[DATATYPE_STR_BUILDER] != "StrBuilder" || datatypes[DATATYPE_SLICE] != "Slice" || datatypes[DATATYPE_LIST_VIEW] != "ListView"
+        || datatypes[DATATYPE_DATA_FRAME] != "DataFrame" || datatypes[DATATYPE_MATRIX] != "Matrix") {
+        parse_error("Datatype numbers are out of date with the list of datatypes");
+    }
 }
 
 //get a string name of the single type number `i`
@@ -48,37 +48,161 @@ const int OP_UNARY_PRI = 16;
     Structs
 */
 
-struct Env {
-    unordered_map<string, RRObj> vars;
+//the builtin functions, operators and lazy params
+//built once, the first time an Env is set up, and then shared by all Envs; nothing changes them afterwards,
+// apart from the profile counters of the functions
+struct Builtins {
     unordered_map<string, vector<RRFun>> funs;
     unordered_map<string, int> op_order;
+    unordered_map<string, vector<bool>> lazy_params;
 
-    static void init_with_default(Env& env) {
+    static void register_all(Builtins& table) {
         //init funs
-        env.funs["+"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Int"), int_add_int));
-        env.funs["+"].push_back(RRFun({RRDataType("Float"), RRDataType("Float")}, RRDataType("Float"), float_add_float));
-        env.funs["+"].push_back(RRFun({RRDataType("Float"), RRDataType("Int")}, RRDataType("Float"), float_add_int));
-        env.funs["+"].push_back(RRFun({RRDataType("Int"), RRDataType("Float")}, RRDataType("Float"), int_add_float));
-        env.funs["+"].push_back(RRFun({RRDataType("Str"), RRDataType("Str")}, RRDataType("Str"), str_add_str));
-        env.funs["+"].push_back(RRFun({RRDataType("Str"), RRDataType("Int")}, RRDataType("Str"), str_add_int));
-        env.funs["*"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Int"), int_multiply_int));
-        env.funs["=="].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Bool"), int_eq_int));
-        env.funs["repeat"].push_back(RRFun({RRDataType("Str"), RRDataType("Int")}, RRDataType("Str"), str_repeat_int));
-        env.funs["round"].push_back(RRFun({RRDataType("Float")}, RRDataType("Int"), round_float));
-        env.funs["max"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Int"), max_int_int));
-        env.funs["print"].push_back(RRFun({RRDataType("Any")}, RRDataType("None"), print_any));
-        env.funs["concat"].push_back(RRFun({RRDataType("List"), RRDataType("Str")}, RRDataType("Str"), concat_list_str));
+        table.funs["+"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Int"), int_add_int));
+        table.funs["+"].push_back(RRFun({RRDataType("Float"), RRDataType("Float")}, RRDataType("Float"), float_add_float));
+        table.funs["+"].push_back(RRFun({RRDataType("Float"), RRDataType("Int")}, RRDataType("Float"), float_add_int));
+        table.funs["+"].push_back(RRFun({RRDataType("Int"), RRDataType("Float")}, RRDataType("Float"), int_add_float));
+        table.funs["+"].push_back(RRFun({RRDataType("Str"), RRDataType("Str")}, RRDataType("Str"), str_add_str));
+        table.funs["+"].push_back(RRFun({RRDataType("Str"), RRDataType("Int")}, RRDataType("Str"), str_add_int));
+        table.funs["*"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Int"), int_multiply_int));
+        table.funs["=="].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Bool"), int_eq_int));
+        table.funs["repeat"].push_back(RRFun({RRDataType("Str"), RRDataType("Int")}, RRDataType("Str"), str_repeat_int));
+        table.funs["round"].push_back(RRFun({RRDataType("Float")}, RRDataType("Int"), round_float));
+        table.funs["max"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Int"), max_int_int));
+        table.funs["print"].push_back(RRFun({RRDataType("Any")}, RRDataType("None"), print_any));
+        table.funs["print_each"].push_back(RRFun({RRDataType("List")}, RRDataType("List"), print_each_list));
+        table.funs["print_each"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Vec"), print_each_vec));
+        table.funs["print_each"].push_back(RRFun({RRDataType("ListView")}, RRDataType("ListView"), print_each_list_view));
+        table.funs["flush"].push_back(RRFun({}, RRDataType("None"), flush_output));
+        table.funs["concat"].push_back(RRFun({RRDataType("List"), RRDataType("Str")}, RRDataType("Str"), concat_list_str));
+        table.funs["StrBuilder"].push_back(RRFun({}, RRDataType("StrBuilder"), new_str_builder));
+        table.funs["StrBuilder"].push_back(RRFun({RRDataType("Str")}, RRDataType("StrBuilder"), str_builder_from_str));
+        table.funs["append"].push_back(RRFun({RRDataType("StrBuilder"), RRDataType("Str")}, RRDataType("StrBuilder"), str_builder_append_str));
+        table.funs["append"].push_back(RRFun({RRDataType("StrBuilder"), RRDataType("Int")}, RRDataType("StrBuilder"), str_builder_append_int));
+        table.funs["Str"].push_back(RRFun({RRDataType("StrBuilder")}, RRDataType("Str"), str_from_str_builder));
+        table.funs[":"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Slice"), int_slice_int));
+        table.funs[":"].push_back(RRFun({RRDataType("Slice"), RRDataType("Int")}, RRDataType("Slice"), slice_step_int));
+        table.funs["sum"].push_back(RRFun({RRDataType("List")}, RRDataType("Any"), sum_list));
+        table.funs["sum"].push_back(RRFun({RRDataType("ListView")}, RRDataType("Any"), sum_list_view));
+        table.funs["len"].push_back(RRFun({RRDataType("List")}, RRDataType("Int"), len_list));
+        table.funs["len"].push_back(RRFun({RRDataType("ListView")}, RRDataType("Int"), len_list_view));
+        table.funs["len"].push_back(RRFun({RRDataType("Str")}, RRDataType("Int"), len_str));
+        table.funs["len"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Int"), len_vec));
+        table.funs["sum"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Any"), sum_vec));
+        table.funs["Vec"].push_back(RRFun({RRDataType("List")}, RRDataType("Vec"), vec_from_list));
+        table.funs["List"].push_back(RRFun({RRDataType("Vec")}, RRDataType("List"), list_from_vec));
+        table.funs["read_csv"].push_back(RRFun({RRDataType("Str")}, RRDataType("DataFrame"), read_csv_str));
+        table.funs["nrow"].push_back(RRFun({RRDataType("DataFrame")}, RRDataType("Int"), nrow_frame));
+        table.funs["ncol"].push_back(RRFun({RRDataType("DataFrame")}, RRDataType("Int"), ncol_frame));
+        table.funs["names"].push_back(RRFun({RRDataType("DataFrame")}, RRDataType("List"), names_frame));
+        table.funs["group_by"].push_back(RRFun({RRDataType("Vec"), RRDataType("Vec"), RRDataType("Str")}, RRDataType("DataFrame"), group_by_vec_vec_str));
+        table.funs["group_by"].push_back(RRFun({RRDataType("DataFrame"), RRDataType("Str"), RRDataType("Str")}, RRDataType("DataFrame"), group_by_frame_str_str));
+        table.funs["sort"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Vec"), sort_vec));
+        table.funs["sort"].push_back(RRFun({RRDataType("List")}, RRDataType("List"), sort_list));
+        table.funs["sort"].push_back(RRFun({RRDataType("DataFrame"), RRDataType("Str")}, RRDataType("DataFrame"), sort_frame_str));
+        table.funs["argsort"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Vec"), argsort_vec));
+        table.funs["argsort"].push_back(RRFun({RRDataType("List")}, RRDataType("Vec"), argsort_list));
+        table.funs["unique"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Vec"), unique_vec));
+        table.funs["unique"].push_back(RRFun({RRDataType("List")}, RRDataType("List"), unique_list));
+        table.funs["unique"].push_back(RRFun({RRDataType("DataFrame")}, RRDataType("DataFrame"), unique_frame));
+        table.funs["join"].push_back(RRFun({RRDataType("DataFrame"), RRDataType("DataFrame"), RRDataType("Str")}, RRDataType("DataFrame"), join_frame_frame_str));
+        table.funs["Matrix"].push_back(RRFun({RRDataType("List")}, RRDataType("Matrix"), matrix_from_list));
+        table.funs["Matrix"].push_back(RRFun({RRDataType("Vec"), RRDataType("Int")}, RRDataType("Matrix"), matrix_from_vec_int));
+        table.funs["diag"].push_back(RRFun({RRDataType("Int")}, RRDataType("Matrix"), diag_int));
+        table.funs["%*%"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Matrix")}, RRDataType("Matrix"), matrix_matmul_matrix));
+        table.funs["%*%"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Vec")}, RRDataType("Vec"), matrix_matmul_vec));
+        table.funs["+"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Matrix")}, RRDataType("Matrix"), matrix_add_matrix));
+        table.funs["*"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Float")}, RRDataType("Matrix"), matrix_multiply_float));
+        table.funs["*"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Int")}, RRDataType("Matrix"), matrix_multiply_int));
+        table.funs["t"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("Matrix"), t_matrix));
+        table.funs["solve"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Matrix")}, RRDataType("Matrix"), solve_matrix_matrix));
+        table.funs["solve"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Vec")}, RRDataType("Vec"), solve_matrix_vec));
+        table.funs["solve"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("Matrix"), solve_matrix));
+        table.funs["det"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("Float"), det_matrix));
+        table.funs["chol"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("Matrix"), chol_matrix));
+        table.funs["lu"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("List"), lu_matrix));
+        table.funs["qr"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("List"), qr_matrix));
+        table.funs["nrow"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("Int"), nrow_matrix));
+        table.funs["ncol"].push_back(RRFun({RRDataType("Matrix")}, RRDataType("Int"), ncol_matrix));
+        table.funs["set_seed"].push_back(RRFun({RRDataType("Int")}, RRDataType("None"), set_seed_int));
+        table.funs["set_seed"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("None"), set_seed_int_int));
+        table.funs["runif"].push_back(RRFun({RRDataType("Int")}, RRDataType("Vec"), runif_int));
+        table.funs["runif"].push_back(RRFun({RRDataType("Int"), RRDataType("Float"), RRDataType("Float")}, RRDataType("Vec"), runif_int_float_float));
+        table.funs["rnorm"].push_back(RRFun({RRDataType("Int")}, RRDataType("Vec"), rnorm_int));
+        table.funs["rnorm"].push_back(RRFun({RRDataType("Int"), RRDataType("Float"), RRDataType("Float")}, RRDataType("Vec"), rnorm_int_float_float));
+        table.funs["rbinom"].push_back(RRFun({RRDataType("Int"), RRDataType("Int"), RRDataType("Float")}, RRDataType("Vec"), rbinom_int_int_float));
+        table.funs["rpois"].push_back(RRFun({RRDataType("Int"), RRDataType("Float")}, RRDataType("Vec"), rpois_int_float));
+        table.funs["rpois"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Vec"), rpois_int_int));
+        table.funs["sample"].push_back(RRFun({RRDataType("Int"), RRDataType("Int")}, RRDataType("Vec"), sample_int_int));
+        table.funs["sample"].push_back(RRFun({RRDataType("Vec"), RRDataType("Int")}, RRDataType("Vec"), sample_vec_int));
+        table.funs["shuffle"].push_back(RRFun({RRDataType("Vec")}, RRDataType("Vec"), shuffle_vec));
+        table.funs["shuffle"].push_back(RRFun({RRDataType("List")}, RRDataType("List"), shuffle_list));
+        table.funs["+"].push_back(RRFun({RRDataType("Vec"), RRDataType("Vec")}, RRDataType("Vec"), vec_add));
+        table.funs["+"].push_back(RRFun({RRDataType("Vec"), RRDataType("Int")}, RRDataType("Vec"), vec_add));
+        table.funs["+"].push_back(RRFun({RRDataType("Vec"), RRDataType("Float")}, RRDataType("Vec"), vec_add));
+        table.funs["+"].push_back(RRFun({RRDataType("Int"), RRDataType("Vec")}, RRDataType("Vec"), vec_add));
+        table.funs["+"].push_back(RRFun({RRDataType("Float"), RRDataType("Vec")}, RRDataType("Vec"), vec_add));
+        table.funs["*"].push_back(RRFun({RRDataType("Vec"), RRDataType("Vec")}, RRDataType("Vec"), vec_multiply));
+        table.funs["*"].push_back(RRFun({RRDataType("Vec"), RRDataType("Int")}, RRDataType("Vec"), vec_multiply));
+        table.funs["*"].push_back(RRFun({RRDataType("Vec"), RRDataType("Float")}, RRDataType("Vec"), vec_multiply));
+        table.funs["*"].push_back(RRFun({RRDataType("Int"), RRDataType("Vec")}, RRDataType("Vec"), vec_multiply));
+        table.funs["*"].push_back(RRFun({RRDataType("Float"), RRDataType("Vec")}, RRDataType("Vec"), vec_multiply));
+        table.funs["mem"].push_back(RRFun({}, RRDataType("Int"), mem));
+        table.funs["save"].push_back(RRFun({RRDataType("Any"), RRDataType("Str")}, RRDataType("None"), save_any_str));
+        table.funs["load"].push_back(RRFun({RRDataType("Str")}, RRDataType("Any"), load_str));
+        table.funs["&&"].push_back(RRFun({RRDataType("Bool"), RRDataType("Expr")}, RRDataType("Bool"), bool_and_expr));
+        table.funs["||"].push_back(RRFun({RRDataType("Bool"), RRDataType("Expr")}, RRDataType("Bool"), bool_or_expr));
+        table.funs["??"].push_back(RRFun({RRDataType("Any"), RRDataType("Expr")}, RRDataType("Any"), any_coalesce_expr));
         //init index funs
-        env.funs["index"].push_back(RRFun({RRDataType("List"), RRDataType("Int")}, RRDataType("Any"), list_int_index));
-        env.funs["index"].push_back(RRFun({RRDataType("List"), RRDataType("List")}, RRDataType("Any"), list_list_index));
+        table.funs["index"].push_back(RRFun({RRDataType("List"), RRDataType("Int")}, RRDataType("Any"), list_int_index));
+        table.funs["index"].push_back(RRFun({RRDataType("List"), RRDataType("List")}, RRDataType("ListView"), list_list_index));
+        table.funs["index"].push_back(RRFun({RRDataType("List"), RRDataType("Slice")}, RRDataType("ListView"), list_slice_index));
+        table.funs["index"].push_back(RRFun({RRDataType("ListView"), RRDataType("Int")}, RRDataType("Any"), list_view_int_index));
+        table.funs["index"].push_back(RRFun({RRDataType("ListView"), RRDataType("List")}, RRDataType("ListView"), list_view_list_index));
+        table.funs["index"].push_back(RRFun({RRDataType("ListView"), RRDataType("Slice")}, RRDataType("ListView"), list_view_slice_index));
+        table.funs["index"].push_back(RRFun({RRDataType("Vec"), RRDataType("Int")}, RRDataType("Any"), vec_int_index));
+        table.funs["index"].push_back(RRFun({RRDataType("DataFrame"), RRDataType("Str")}, RRDataType("Vec"), frame_str_index));
+        table.funs["index"].push_back(RRFun({RRDataType("DataFrame"), RRDataType("Int")}, RRDataType("Vec"), frame_int_index));
+        table.funs["index"].push_back(RRFun({RRDataType("Matrix"), RRDataType("Int")}, RRDataType("Vec"), matrix_int_index));
         //init op_order
-        env.op_order["="] = OP_LOW_PRI; //both sides get evaluated first
-        env.op_order["=="] = OP_LOW_PRI+2;
-        env.op_order["repeat"] = OP_LOW_PRI+3;
-        env.op_order["+"] = OP_HIGH_PRI-5;
-        env.op_order["*"] = OP_HIGH_PRI-4;
+        table.op_order["="] = OP_LOW_PRI; //both sides get evaluated first
+        table.op_order["??"] = OP_LOW_PRI+1;
+        table.op_order["||"] = OP_LOW_PRI+2;
+        table.op_order["&&"] = OP_LOW_PRI+3;
+        table.op_order["=="] = OP_LOW_PRI+4;
+        table.op_order["repeat"] = OP_LOW_PRI+5;
+        table.op_order[":"] = OP_LOW_PRI+6;
+        table.op_order["+"] = OP_HIGH_PRI-5;
+        table.op_order["*"] = OP_HIGH_PRI-4;
+        table.op_order["%*%"] = OP_HIGH_PRI-3;
         //declare unary ops
-        env.op_order["round"] = OP_UNARY_PRI;
+        table.op_order["round"] = OP_UNARY_PRI;
+        //declare lazy params; they are given to the function as unevaluated `Expr` objects
+        table.lazy_params["&&"] = {false, true};
+        table.lazy_params["||"] = {false, true};
+        table.lazy_params["??"] = {false, true};
+    }
+};
+
+Builtins& default_builtins() {
+    static Builtins table = []() {
+        Builtins table;
+        Builtins::register_all(table);
+        return table;
+    }();
+    return table;
+}
+
+struct Env {
+    unordered_map<string, RRObj> vars;
+    Builtins* builtins = nullptr;
+    //functions, operators and lazy params of this Env only; they are looked up before the builtins
+    unordered_map<string, vector<RRFun>> funs;
+    unordered_map<string, int> op_order;
+    unordered_map<string, vector<bool>> lazy_params;
+
+    static void init_with_default(Env& env) {
+        env.builtins = &default_builtins();
     }
 
     RRObj get_var_or_new(string& name) {
@@ -100,24 +224,16 @@ struct Env {
         return vars[name];
     }
     RRFun* get_fun(string& name, vector<RRDataType>& arg_types) {
-        if(funs.find(name) != funs.end()) {
-            for(int i = 0; i < funs[name].size(); i++) {
-                //check if `f.params` vector is equal to `arg_types` vector
-                //and yes, it's important that function params are on the **right** (i know it's not a good practice)
-                if(arg_types == funs[name][i].params) {
-                    return &funs[name][i];
-                }
-            }
-        }
+        RRFun* fun = find_fun(funs, name, arg_types);
+        if(fun == nullptr && builtins != nullptr) fun = find_fun(builtins->funs, name, arg_types);
+        if(fun != nullptr) return fun;
         //print an error
         string arg_str = "";
-        for(int i = 0; i < arg_types.size()-1; i++) {
+        for(int i = 0; i < arg_types.size(); i++) {
+            if(i > 0) arg_str += ",";
             arg_str += single_type_of(arg_types[i].type);
-            arg_str += ",";
         }
-        arg_str += single_type_of(arg_types[arg_types.size()-1].type);
         rr_runtime_error("Couldn't find a function '"s + name + "<" + arg_str + ">'");
-        exit(1);
     }
     RRObj assign_var(string& name, RRObj obj) {
         if(!obj.owner) rr_runtime_error("Cannot store a reference to an object: ");
@@ -125,17 +241,83 @@ struct Env {
         return obj;
     }
 
+    //the overload of `name` in `table` taking exactly `arg_types`; nullptr if there's none
+    static RRFun* find_fun(unordered_map<string, vector<RRFun>>& table, string& name, vector<RRDataType>& arg_types) {
+        auto overloads = table.find(name);
+        if(overloads == table.end()) return nullptr;
+        for(int i = 0; i < overloads->second.size(); i++) {
+            //check if `f.params` vector is equal to `arg_types` vector
+            //and yes, it's important that function params are on the **right** (i know it's not a good practice)
+            if(arg_types == overloads->second[i].params) {
+                return &overloads->second[i];
+            }
+        }
+        return nullptr;
+    }
+
+    //return which params of function `name` are lazy; nullptr if all of them are evaluated eagerly
+    vector<bool>* get_lazy_params(string& name) {
+        auto lazy = lazy_params.find(name);
+        if(lazy != lazy_params.end()) return &lazy->second;
+        if(builtins == nullptr) return nullptr;
+        lazy = builtins->lazy_params.find(name);
+        if(lazy == builtins->lazy_params.end()) return nullptr;
+        return &lazy->second;
+    }
+
     //check whether the function list contains this name
     bool is_fun(string& name) {
-        return funs.find(name) != funs.end();
+        return funs.find(name) != funs.end() || (builtins != nullptr && builtins->funs.find(name) != builtins->funs.end());
     }
     //if an operator order has been established for this name, it's an operator
     bool is_op(string& name) {
-        return op_order.find(name) != op_order.end();
+        return op_priority(name) >= 0;
+    }
+
+    //priority of operator `name`; -1 if it's not an operator
+    int op_priority(string& name) {
+        auto order = op_order.find(name);
+        if(order != op_order.end()) return order->second;
+        if(builtins == nullptr) return -1;
+        order = builtins->op_order.find(name);
+        return order == builtins->op_order.end() ? -1 : order->second;
     }
 
     //return true if right operator has higher priority than left operator
     bool op_priority_higher(string& lop, string& rop) {
-        return op_order[rop] > op_order[lop];
+        return op_priority(rop) > op_priority(lop);
+    }
+
+    //add a row for every builtin that was called, as `name(param types)`
+    void collect_profile(vector<ProfileRow>& rows) {
+        collect_profile(funs, rows);
+        if(builtins != nullptr) collect_profile(builtins->funs, rows);
+    }
+    static void collect_profile(unordered_map<string, vector<RRFun>>& table, vector<ProfileRow>& rows) {
+        for(auto& entry : table) {
+            for(int i = 0; i < entry.second.size(); i++) {
+                RRFun& fun = entry.second[i];
+                if(fun.prof.count == 0) continue;
+                string signature = entry.first + "(";
+                for(int p = 0; p < fun.params.size(); p++) {
+                    if(p > 0) signature += ", ";
+                    signature += single_type_of(fun.params[p].type);
+                }
+                rows.push_back({"", signature + ")", fun.prof});
+            }
+        }
+    }
+
+    //add a row for every type of value held by variables, biggest first
+    void collect_mem_stats(vector<MemRow>& rows) {
+        vector<MemRow> by_type;
+        for(int t = 0; t < datatypes.size(); t++) by_type.push_back({single_type_of(t), 0, 0});
+        for(auto& var : vars) value_memory(var.second, by_type);
+        for(int t = 0; t < by_type.size(); t++) {
+            if(by_type[t].count > 0) rows.push_back(by_type[t]);
+        }
+        sort(rows.begin(), rows.end(), [](const MemRow& a, const MemRow& b) {
+            return a.bytes > b.bytes;
+        });
     }
 };
\ No newline at end of file
@@ -0,0 +1,372 @@
+// Group rows by a key column and aggregate other columns per group
+// Groups come out in the order their keys first appear.
+// Rows are hashed into a flat open-addressing table that stores group ids, and every aggregate is then
+// computed with one tight loop over a whole column, instead of a function call per element.
+// Big inputs are split into partitions by key hash, which are hashed and grouped on separate threads.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "datatypes.h"
+#include "rr_vec.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//inputs with fewer rows than this are grouped on a single thread
+const size_t GROUP_MIN_PARALLEL_ROWS = 1 << 20;
+
+enum GroupAgg {
+    AGG_SUM,
+    AGG_COUNT,
+    AGG_MEAN,
+    AGG_MIN,
+    AGG_MAX
+};
+
+/*
+    Structs
+*/
+
+//result of grouping a key column
+struct Grouping {
+    vector<uint32_t> group_of; //group id of every row
+    vector<size_t> first_rows; //first row of every group, in the order of group ids
+};
+
+//a key column, read through plain pointers; only the one for its element type is set
+//(checking the type of a Vec per row would cost a lookup by type name)
+struct GroupKeys {
+    const long long* ints;
+    const double* floats;
+    const string* strs;
+
+    GroupKeys(const RRVec& keys) {
+        ints = nullptr;
+        floats = nullptr;
+        strs = nullptr;
+        if(keys.holds_strs()) strs = keys.strs.data();
+        else if(keys.holds_floats()) floats = keys.float_data();
+        else ints = keys.int_data();
+    }
+
+    bool same(size_t a, size_t b) const {
+        return same(a, *this, b);
+    }
+    //whether key `a` equals key `b` of `other`, a column of the same type
+    bool same(size_t a, const GroupKeys& other, size_t b) const {
+        if(ints != nullptr) return ints[a] == other.ints[b];
+        if(floats != nullptr) return float_bits(floats[a]) == float_bits(other.floats[b]);
+        return strs[a] == other.strs[b];
+    }
+
+    uint64_t hash(size_t row) const {
+        if(ints != nullptr) return mix(ints[row]);
+        if(floats != nullptr) return mix(float_bits(floats[row]));
+        return mix(std::hash<string>()(strs[row]));
+    }
+
+    //splitmix64 finalizer, so that sequential keys don't cluster
+    static uint64_t mix(uint64_t num) {
+        num ^= num >> 30;
+        num *= 0xbf58476d1ce4e5b9ULL;
+        num ^= num >> 27;
+        num *= 0x94d049bb133111ebULL;
+        return num ^ (num >> 31);
+    }
+
+    //all NaNs are one key, and so are 0.0 and -0.0
+    static uint64_t float_bits(double num) {
+        if(num == 0) num = 0;
+        if(isnan(num)) num = NAN;
+        uint64_t bits;
+        memcpy(&bits, &num, 8);
+        return bits;
+    }
+};
+
+//open addressing hash table from keys to group ids, for rows of a single key column
+//keys aren't copied in; a group is represented by its first row
+struct GroupTable {
+    const GroupKeys& keys;
+    vector<uint32_t> slots; //group id + 1; 0 for an empty slot
+    vector<uint64_t> group_hashes;
+    vector<size_t>& first_rows;
+    size_t mask;
+
+    GroupTable(const GroupKeys& keys, vector<size_t>& first_rows, size_t expected) : keys(keys), first_rows(first_rows) {
+        size_t cap = 16;
+        while(cap < expected * 2) cap *= 2;
+        slots.assign(cap, 0);
+        mask = cap - 1;
+    }
+
+    //group id of `row`, whose key hashes to `hash`; a new group is added for an unseen key
+    uint32_t find_or_add(size_t row, uint64_t hash) {
+        size_t slot = hash & mask;
+        while(slots[slot] != 0) {
+            uint32_t group = slots[slot] - 1;
+            if(group_hashes[group] == hash && keys.same(first_rows[group], row)) return group;
+            slot = (slot + 1) & mask;
+        }
+        uint32_t group = first_rows.size();
+        slots[slot] = group + 1;
+        group_hashes.push_back(hash);
+        first_rows.push_back(row);
+        if(first_rows.size() * 2 > slots.size()) grow();
+        return group;
+    }
+
+    //group id of key `row` of `probe` (a column of the same type as `keys`); -1 if it has no group
+    long long find(const GroupKeys& probe, size_t row) const {
+        uint64_t hash = probe.hash(row);
+        size_t slot = hash & mask;
+        while(slots[slot] != 0) {
+            uint32_t group = slots[slot] - 1;
+            if(group_hashes[group] == hash && keys.same(first_rows[group], probe, row)) return group;
+            slot = (slot + 1) & mask;
+        }
+        return -1;
+    }
+
+    //fill the table with the groups already in `first_rows`
+    void insert_groups() {
+        group_hashes.resize(first_rows.size());
+        for(size_t group = 0; group < first_rows.size(); group++) group_hashes[group] = keys.hash(first_rows[group]);
+        size_t cap = slots.size();
+        while(cap < first_rows.size() * 2) cap *= 2;
+        rebuild(cap);
+    }
+
+    void grow() {
+        rebuild(slots.size() * 2);
+    }
+
+    void rebuild(size_t cap) {
+        slots.assign(cap, 0);
+        mask = cap - 1;
+        for(uint32_t group = 0; group < group_hashes.size(); group++) {
+            size_t slot = group_hashes[group] & mask;
+            while(slots[slot] != 0) slot = (slot + 1) & mask;
+            slots[slot] = group + 1;
+        }
+    }
+};
+
+/*
+    Functions
+*/
+
+GroupAgg group_agg_of(const string& name) {
+    if(name == "sum") return AGG_SUM;
+    if(name == "count") return AGG_COUNT;
+    if(name == "mean") return AGG_MEAN;
+    if(name == "min") return AGG_MIN;
+    if(name == "max") return AGG_MAX;
+    rr_runtime_error("Unknown aggregate '"s + name + "'; expected sum, count, mean, min or max");
+    exit(1);
+}
+
+//group every row of `keys` on this thread
+Grouping group_rows(const RRVec& vec) {
+    GroupKeys keys(vec);
+    Grouping grouping;
+    size_t rows = vec.size();
+    grouping.group_of.resize(rows);
+    GroupTable table(keys, grouping.first_rows, 1024);
+    for(size_t row = 0; row < rows; row++) {
+        grouping.group_of[row] = table.find_or_add(row, keys.hash(row));
+    }
+    return grouping;
+}
+
+//group every row of `keys`, with the rows split into `nparts` partitions by hash, grouped in parallel
+//gives the same group ids as `group_rows`
+Grouping group_rows_partitioned(const RRVec& vec, size_t nparts) {
+    GroupKeys keys(vec);
+    size_t rows = vec.size();
+    vector<uint64_t> hashes(rows);
+    vector<thread> workers;
+    for(size_t t = 0; t < nparts; t++) {
+        workers.push_back(thread([&, t]() {
+            for(size_t row = rows * t / nparts; row < rows * (t + 1) / nparts; row++) hashes[row] = keys.hash(row);
+        }));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    //rows of every partition, in increasing order; the top bits pick the partition, the table uses the bottom ones
+    vector<vector<size_t>> part_rows(nparts);
+    for(size_t row = 0; row < rows; row++) part_rows[(hashes[row] >> 32) % nparts].push_back(row);
+
+    //group each partition; keys never repeat across partitions, so neither do groups
+    Grouping grouping;
+    grouping.group_of.resize(rows);
+    vector<vector<size_t>> part_first_rows(nparts);
+    for(size_t t = 0; t < nparts; t++) {
+        workers.push_back(thread([&, t]() {
+            GroupTable table(keys, part_first_rows[t], part_rows[t].size() / 16);
+            for(size_t row : part_rows[t]) grouping.group_of[row] = table.find_or_add(row, hashes[row]);
+        }));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    //number groups by their first row, like `group_rows` does
+    vector<pair<size_t, uint32_t>> order; //first row, partition
+    for(size_t t = 0; t < nparts; t++) {
+        for(size_t row : part_first_rows[t]) order.push_back({row, t});
+    }
+    sort(order.begin(), order.end());
+    vector<vector<uint32_t>> renumber(nparts);
+    for(size_t t = 0; t < nparts; t++) renumber[t].resize(part_first_rows[t].size());
+    vector<uint32_t> next(nparts, 0);
+    for(uint32_t group = 0; group < order.size(); group++) {
+        uint32_t t = order[group].second;
+        renumber[t][next[t]++] = group;
+        grouping.first_rows.push_back(order[group].first);
+    }
+    for(size_t t = 0; t < nparts; t++) {
+        workers.push_back(thread([&, t]() {
+            for(size_t row : part_rows[t]) grouping.group_of[row] = renumber[t][grouping.group_of[row]];
+        }));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+    return grouping;
+}
+
+Grouping group_keys(const RRVec& keys) {
+    size_t nparts = min((size_t) thread::hardware_concurrency(), keys.size() / GROUP_MIN_PARALLEL_ROWS);
+    if(nparts <= 1) return group_rows(keys);
+    return group_rows_partitioned(keys, nparts);
+}
+
+//the key of every group, as a new Vec
+RRVec* group_key_column(const RRVec& keys, const Grouping& grouping) {
+    RRVec* res = new RRVec(keys.elem);
+    size_t ngroups = grouping.first_rows.size();
+    if(keys.holds_strs()) {
+        res->strs.reserve(ngroups);
+        for(size_t group = 0; group < ngroups; group++) res->strs.push_back(keys.strs[grouping.first_rows[group]]);
+    } else if(keys.holds_floats()) {
+        res->floats.resize(ngroups);
+        for(size_t group = 0; group < ngroups; group++) res->floats[group] = keys.float_data()[grouping.first_rows[group]];
+    } else {
+        res->ints.resize(ngroups);
+        for(size_t group = 0; group < ngroups; group++) res->ints[group] = keys.int_data()[grouping.first_rows[group]];
+    }
+    return res;
+}
+
+//`agg` of numbers `vals` in every group, into `res` (which starts out with one `init` per group)
+template<typename T, typename Acc, typename Update>
+void group_fold(const T* vals, const Grouping& grouping, vector<Acc>& res, Update update) {
+    const uint32_t* group_of = grouping.group_of.data();
+    size_t rows = grouping.group_of.size();
+    for(size_t row = 0; row < rows; row++) update(res[group_of[row]], vals[row]);
+}
+
+template<typename T>
+void group_min_max(const T* vals, const Grouping& grouping, vector<T>& res, GroupAgg agg) {
+    size_t ngroups = grouping.first_rows.size();
+    res.resize(ngroups);
+    for(size_t group = 0; group < ngroups; group++) res[group] = vals[grouping.first_rows[group]];
+    if(agg == AGG_MIN) group_fold(vals, grouping, res, [](T& acc, T val) { if(val < acc) acc = val; });
+    else group_fold(vals, grouping, res, [](T& acc, T val) { if(val > acc) acc = val; });
+}
+
+//`agg` of `vals` in every group, as a new Vec
+//sum of Int (or Bool) stays an Int, mean is a Float, min and max keep the type of `vals`
+RRVec* group_aggregate(const RRVec& vals, const Grouping& grouping, GroupAgg agg) {
+    size_t ngroups = grouping.first_rows.size();
+    if(vals.size() != grouping.group_of.size()) rr_runtime_error("Keys and values have different lengths");
+    if(agg == AGG_COUNT) {
+        RRVec* res = new RRVec(RRDataType("Int"));
+        res->ints.assign(ngroups, 0);
+        for(size_t row = 0; row < grouping.group_of.size(); row++) res->ints[grouping.group_of[row]]++;
+        return res;
+    }
+    if(vals.holds_strs()) rr_runtime_error("Cannot aggregate a Vec of Str (only `count`)");
+
+    bool floats = vals.holds_floats();
+    switch(agg) {
+        case AGG_SUM: {
+            if(floats) {
+                RRVec* res = new RRVec(RRDataType("Float"));
+                res->floats.assign(ngroups, 0);
+                group_fold(vals.float_data(), grouping, res->floats, [](double& acc, double val) { acc += val; });
+                return res;
+            }
+            RRVec* res = new RRVec(RRDataType("Int"));
+            res->ints.assign(ngroups, 0);
+            group_fold(vals.int_data(), grouping, res->ints, [](long long& acc, long long val) { acc += val; });
+            return res;
+        };
+        case AGG_MEAN: {
+            RRVec* res = new RRVec(RRDataType("Float"));
+            res->floats.assign(ngroups, 0);
+            if(floats) group_fold(vals.float_data(), grouping, res->floats, [](double& acc, double val) { acc += val; });
+            else group_fold(vals.int_data(), grouping, res->floats, [](double& acc, long long val) { acc += val; });
+            vector<size_t> counts(ngroups, 0);
+            for(size_t row = 0; row < grouping.group_of.size(); row++) counts[grouping.group_of[row]]++;
+            for(size_t group = 0; group < ngroups; group++) res->floats[group] /= counts[group];
+            return res;
+        };
+        case AGG_MIN:
+        case AGG_MAX: {
+            RRVec* res = new RRVec(vals.elem);
+            if(floats) group_min_max(vals.float_data(), grouping, res->floats, agg);
+            else group_min_max(vals.int_data(), grouping, res->ints, agg);
+            return res;
+        };
+        default: break;
+    }
+    rr_runtime_error("Invalid aggregate");
+    exit(1);
+}
+
+//group `vals` by `keys`; a DataFrame with columns `key` and `agg`
+RRDataFrame* group_by_vec(const RRVec& keys, const RRVec& vals, const string& agg_name) {
+    GroupAgg agg = group_agg_of(agg_name);
+    if(keys.size() != vals.size()) rr_runtime_error("Keys and values have different lengths");
+    Grouping grouping = group_keys(keys);
+    RRDataFrame* frame = new RRDataFrame();
+    frame->names = {"key", agg_name};
+    frame->columns.push_back(group_key_column(keys, grouping));
+    frame->columns.push_back(group_aggregate(vals, grouping, agg));
+    return frame;
+}
+
+//group `from` by column `key`; every other column is aggregated with `agg`, and keeps its name
+//Str columns can only be counted, so with other aggregates they are left out
+RRDataFrame* group_by_frame(const RRDataFrame& from, const string& key, const string& agg_name) {
+    GroupAgg agg = group_agg_of(agg_name);
+    int key_col = from.column_of(key);
+    if(key_col < 0) rr_runtime_error("DataFrame has no column '"s + key + "'");
+    for(int col = 0; col < from.columns.size(); col++) {
+        if(from.columns[col] == nullptr) rr_runtime_error("Cannot group a DataFrame that has given away a column");
+    }
+    Grouping grouping = group_keys(*from.columns[key_col]);
+    RRDataFrame* frame = new RRDataFrame();
+    frame->names.push_back(key);
+    frame->columns.push_back(group_key_column(*from.columns[key_col], grouping));
+    for(int col = 0; col < from.columns.size(); col++) {
+        if(col == key_col) continue;
+        if(agg != AGG_COUNT && from.columns[col]->holds_strs()) continue;
+        frame->names.push_back(from.names[col]);
+        frame->columns.push_back(group_aggregate(*from.columns[col], grouping, agg));
+    }
+    return frame;
+}
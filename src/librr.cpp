@@ -0,0 +1,236 @@
+// librr: the interpreter behind the API in librr.h
+// This is the library's only translation unit; like main.cpp, it includes the interpreter's headers directly.
+
+#include <string>
+#include <vector>
+
+#include "librr.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "environment.h"
+
+using namespace std;
+
+/*
+    Functions
+*/
+
+//set up the datatypes the first time the library is used
+void librr_init() {
+    static bool ready = (init_datatypes(), true);
+    (void) ready;
+}
+
+//an environment with only the builtins, which the parser reads operators from
+::Env& librr_parse_env() {
+    static ::Env env = []() {
+        ::Env env;
+        Env::init_with_default(env);
+        return env;
+    }();
+    return env;
+}
+
+//an owned RRObj holding a copy of `value`; values with no RR type (like OTHER) give None
+RRObj rr_obj_of_value(const rr::Value& value) {
+    RRObj obj;
+    switch(value.kind) {
+        case rr::Value::BOOL: obj.type = RRDataType("Bool"); obj.data_bool = value.b; break;
+        case rr::Value::INT: obj.type = RRDataType("Int"); obj.data_int = value.i; break;
+        case rr::Value::FLOAT: obj.type = RRDataType("Float"); obj.data_float = value.f; break;
+        case rr::Value::STR: {
+            obj.type = RRDataType("Str");
+            obj.data_str = new string(value.str);
+        }; break;
+        case rr::Value::LIST: {
+            obj.type = RRDataType("List");
+            obj.data_list = new vector<RRObj>();
+            obj.data_list->reserve(value.list.size());
+            for(int i = 0; i < value.list.size(); i++) obj.data_list->push_back(rr_obj_of_value(value.list[i]));
+        }; break;
+        case rr::Value::VEC: {
+            RRVec* vec;
+            switch(value.elem) {
+                case rr::Value::BOOL: vec = new RRVec(RRDataType("Bool")); vec->ints = value.ints; break;
+                case rr::Value::INT: vec = new RRVec(RRDataType("Int")); vec->ints = value.ints; break;
+                case rr::Value::FLOAT: vec = new RRVec(RRDataType("Float")); vec->floats = value.floats; break;
+                case rr::Value::STR: vec = new RRVec(RRDataType("Str")); vec->strs = value.strs; break;
+                default: return obj;
+            }
+            obj.type = RRDataType("Vec");
+            obj.data_vec = vec;
+        }; break;
+        default: break;
+    }
+    return obj;
+}
+
+rr::Value value_of_rr_obj(const RRObj& obj) {
+    rr::Value value;
+    switch(obj.type.type) {
+        case DATATYPE_STR:
+        case DATATYPE_STR_BUILDER: return rr::Value(*obj.data_str);
+        case DATATYPE_LIST: {
+            value.kind = rr::Value::LIST;
+            value.list.reserve(obj.data_list->size());
+            for(int i = 0; i < obj.data_list->size(); i++) value.list.push_back(value_of_rr_obj((*obj.data_list)[i]));
+            return value;
+        };
+        case DATATYPE_LIST_VIEW: {
+            value.kind = rr::Value::LIST;
+            value.list.reserve(obj.data_view->len);
+            for(long long i = 0; i < obj.data_view->len; i++) value.list.push_back(value_of_rr_obj(obj.data_view->at(i)));
+            return value;
+        };
+        case DATATYPE_VEC: {
+            RRVec* vec = obj.data_vec;
+            value.kind = rr::Value::VEC;
+            if(vec->holds_floats()) {
+                value.elem = rr::Value::FLOAT;
+                value.floats.assign(vec->float_data(), vec->float_data() + vec->size());
+            } else if(vec->holds_strs()) {
+                value.elem = rr::Value::STR;
+                value.strs = vec->strs;
+            } else {
+                value.elem = vec->elem == RRDataType("Bool") ? rr::Value::BOOL : rr::Value::INT;
+                value.ints.assign(vec->int_data(), vec->int_data() + vec->size());
+            }
+            return value;
+        };
+        default: break;
+    }
+    if(obj.type == RRDataType("Bool")) return rr::Value(obj.data_bool);
+    if(obj.type == RRDataType("Int")) return rr::Value(obj.data_int);
+    if(obj.type == RRDataType("Float")) return rr::Value(obj.data_float);
+    if(obj.type == RRDataType("None")) return value;
+    //no C++ counterpart; give it as it would be printed, without the type
+    OutBuffer out(nullptr);
+    out << obj;
+    value.kind = rr::Value::OTHER;
+    value.str = string(out.data, out.len);
+    return value;
+}
+
+namespace rr {
+
+/*
+    Env
+*/
+
+struct Env::Impl {
+    ::Env env;
+};
+
+Env::Env() : impl(new Impl()) {
+    librr_init();
+    ::Env::init_with_default(impl->env);
+}
+
+Env::~Env() {}
+
+void Env::set(const string& name, const Value& value) {
+    RRObj obj = rr_obj_of_value(value);
+    RRObj& slot = impl->env.vars[name];
+    RRObj replaced = move(slot); //released when this returns
+    slot = obj;
+    obj.owner = false; //`slot` took over the data
+}
+
+bool Env::get(const string& name, Value& value) const {
+    auto var = impl->env.vars.find(name);
+    if(var == impl->env.vars.end()) return false;
+    value = value_of_rr_obj(var->second);
+    return true;
+}
+
+bool Env::has(const string& name) const {
+    return impl->env.vars.find(name) != impl->env.vars.end();
+}
+
+void Env::erase(const string& name) {
+    impl->env.vars.erase(name);
+}
+
+void Env::clear() {
+    impl->env.vars.clear();
+}
+
+/*
+    Program
+*/
+
+struct Program::Impl {
+    ASTNode* root = nullptr;
+    string error;
+    bool parse_error = false;
+
+    ~Impl() {
+        if(root != nullptr) delete_ast(root);
+    }
+};
+
+bool Program::ok() const {
+    return impl != nullptr && impl->root != nullptr;
+}
+
+const string& Program::error() const {
+    static const string NOT_COMPILED = "Program was never compiled";
+    return impl == nullptr ? NOT_COMPILED : impl->error;
+}
+
+Result Program::run(Env& env) const {
+    Result result;
+    if(!ok()) {
+        result.error = error();
+        result.parse_error = impl != nullptr && impl->parse_error;
+        return result;
+    }
+    try {
+        RRObj value = impl->root->eval(env.impl->env);
+        result.value = value_of_rr_obj(value);
+        result.ok = true;
+    } catch(RRError& error) {
+        result.error = "Runtime error: "s + error.what();
+    } catch(bad_alloc&) {
+        result.error = "Runtime error: Out of memory";
+    } catch(exception& error) {
+        result.error = "Runtime error: "s + error.what();
+    }
+    rr_out.flush();
+    return result;
+}
+
+/*
+    Functions
+*/
+
+Program compile(const string& source) {
+    librr_init();
+    Program program;
+    program.impl = make_shared<Program::Impl>();
+    try {
+        vector<Token> tokens = Tokenizer::from_source(source).tokenize();
+        program.impl->root = Parser::from_tokens(tokens).parse(librr_parse_env());
+    } catch(RRError& error) {
+        //the part of the tree built before the error is lost
+        program.impl->error = (error.parsing ? "Error while parsing: "s : "Runtime error: "s) + error.what();
+        program.impl->parse_error = error.parsing;
+    } catch(exception& error) {
+        program.impl->error = "Error while parsing: "s + error.what();
+        program.impl->parse_error = true;
+    }
+    return program;
+}
+
+void set_output(FILE* sink) {
+    rr_out.flush();
+    rr_out.sink = sink;
+}
+
+string take_output() {
+    string output(rr_out.data, rr_out.len);
+    if(rr_out.sink == nullptr) rr_out.len = 0;
+    return output;
+}
+
+}
@@ -0,0 +1,120 @@
+// Embedding RR in a C++ program: compile a script once, then run it as often as needed against different inputs
+// Build the library with `make librr.a`, include this header, and link with `librr.a -pthread`.
+// Errors in a script never exit the host: `compile` and `run` hand them back as failed results.
+//
+//     rr::Program program = rr::compile("total = price * count\ntotal");
+//     rr::Env env;
+//     env.set("price", rr::Value(12));
+//     env.set("count", rr::Value(3));
+//     rr::Result result = program.run(env); //result.value.i == 36
+//
+// librr leaves the global `new` and `delete` to the host; only the interpreter itself uses the pools in mem_stats.h.
+// Output of `print` and the random number generator are per thread, so several threads can run programs
+// (even the same Program) at the same time, as long as each one uses its own Env.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+
+namespace rr {
+
+/*
+    Structs
+*/
+
+//an RR value, copied out of or into an environment
+struct Value {
+    enum Kind { NONE, BOOL, INT, FLOAT, STR, LIST, VEC, OTHER };
+
+    Kind kind = NONE;
+    bool b = false;
+    long long i = 0;
+    double f = 0;
+    std::string str; //for STR; for OTHER, the value as `print` shows it
+    std::vector<Value> list;
+    //a Vec holds elements of kind `elem` (BOOL, INT, FLOAT or STR): BOOL and INT ones in `ints`, FLOAT in `floats`, STR in `strs`
+    Kind elem = NONE;
+    std::vector<long long> ints;
+    std::vector<double> floats;
+    std::vector<std::string> strs;
+
+    Value() {}
+    Value(bool b) : kind(BOOL), b(b) {}
+    Value(int i) : kind(INT), i(i) {}
+    Value(long long i) : kind(INT), i(i) {}
+    Value(double f) : kind(FLOAT), f(f) {}
+    Value(const char* str) : kind(STR), str(str) {}
+    Value(const std::string& str) : kind(STR), str(str) {}
+    Value(const std::vector<Value>& list) : kind(LIST), list(list) {}
+    Value(const std::vector<long long>& ints) : kind(VEC), elem(INT), ints(ints) {}
+    Value(const std::vector<double>& floats) : kind(VEC), elem(FLOAT), floats(floats) {}
+    Value(const std::vector<std::string>& strs) : kind(VEC), elem(STR), strs(strs) {}
+};
+
+//what running a program gave: its last value, or the error that stopped it
+struct Result {
+    bool ok = false;
+    Value value;
+    std::string error; //as the interpreter would print it, without the `--RR: ` prefix
+    bool parse_error = false;
+
+    explicit operator bool() const {
+        return ok;
+    }
+};
+
+//variables and builtins that programs run against
+//variables set by one run stay for the next; setting the inputs again before each run is enough
+class Env {
+public:
+    Env();
+    ~Env();
+    Env(const Env&) = delete;
+    Env& operator=(const Env&) = delete;
+
+    //values of kind OTHER can't be given back to RR, and are set as None
+    void set(const std::string& name, const Value& value);
+    //false when there's no variable `name`
+    bool get(const std::string& name, Value& value) const;
+    bool has(const std::string& name) const;
+    void erase(const std::string& name);
+    //remove all variables
+    void clear();
+
+    struct Impl;
+private:
+    std::unique_ptr<Impl> impl;
+    friend class Program;
+};
+
+//a compiled script; running it doesn't change it, so it can be run any number of times, in any Env
+//copies share the compiled code
+class Program {
+public:
+    //false when the source didn't compile; `run` then returns the same error
+    bool ok() const;
+    const std::string& error() const;
+    Result run(Env& env) const;
+
+    struct Impl;
+private:
+    std::shared_ptr<Impl> impl;
+    friend Program compile(const std::string& source);
+};
+
+/*
+    Functions
+*/
+
+Program compile(const std::string& source);
+
+//where `print` writes to on this thread; stdout by default
+//with nullptr, output is kept until `take_output` is called
+void set_output(FILE* sink);
+//everything printed since the last call, when there's no output sink
+std::string take_output();
+
+}
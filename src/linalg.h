@@ -0,0 +1,275 @@
+// Linear algebra on Matrix: multiplication, transpose, solving systems and decompositions
+// Multiplication is cache blocked: a block of B's rows is reused by every row of A while it is still in cache,
+// and each 4x8 tile of the result is kept in registers for the whole inner loop. Big products are split by rows
+// across threads. The decompositions are the textbook algorithms, with partial pivoting for LU.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#include "rr_matrix.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//rows x cols of the result tile kept in registers
+const size_t MM_TILE_ROWS = 4;
+const size_t MM_TILE_COLS = 8;
+//rows of B (columns of A) and columns of B per cache block
+const size_t MM_BLOCK_K = 256;
+const size_t MM_BLOCK_N = 512;
+//products with fewer multiply-adds than this run on a single thread
+const size_t MM_MIN_PARALLEL_WORK = 1 << 24;
+//side of the square blocks copied by `transpose`
+const size_t TRANSPOSE_BLOCK = 32;
+
+/*
+    Functions
+*/
+
+//c[i..i+4, j..j+8] += a[i..i+4, k_from..k_to] * b[k_from..k_to, j..j+8]
+void mm_tile(const RRMatrix& a, const RRMatrix& b, RRMatrix& c, size_t i, size_t j, size_t k_from, size_t k_to) {
+    double acc[MM_TILE_ROWS][MM_TILE_COLS] = {};
+    const double* a_rows[MM_TILE_ROWS];
+    for(size_t r = 0; r < MM_TILE_ROWS; r++) a_rows[r] = a.row(i + r);
+    for(size_t k = k_from; k < k_to; k++) {
+        const double* b_row = b.row(k) + j;
+        for(size_t r = 0; r < MM_TILE_ROWS; r++) {
+            double a_val = a_rows[r][k];
+            for(size_t col = 0; col < MM_TILE_COLS; col++) acc[r][col] += a_val * b_row[col];
+        }
+    }
+    for(size_t r = 0; r < MM_TILE_ROWS; r++) {
+        double* c_row = c.row(i + r) + j;
+        for(size_t col = 0; col < MM_TILE_COLS; col++) c_row[col] += acc[r][col];
+    }
+}
+
+//same as `mm_tile`, for the partial tiles at the bottom and right edges of c
+void mm_edge(const RRMatrix& a, const RRMatrix& b, RRMatrix& c, size_t i, size_t i_to, size_t j, size_t j_to, size_t k_from, size_t k_to) {
+    for(size_t r = i; r < i_to; r++) {
+        double* c_row = c.row(r);
+        const double* a_row = a.row(r);
+        for(size_t k = k_from; k < k_to; k++) {
+            double a_val = a_row[k];
+            const double* b_row = b.row(k);
+            for(size_t col = j; col < j_to; col++) c_row[col] += a_val * b_row[col];
+        }
+    }
+}
+
+//rows [row_from, row_to) of c = a * b
+void matmul_rows(const RRMatrix& a, const RRMatrix& b, RRMatrix& c, size_t row_from, size_t row_to) {
+    size_t n = b.cols;
+    size_t inner = a.cols;
+    for(size_t kk = 0; kk < inner; kk += MM_BLOCK_K) {
+        size_t k_to = min(kk + MM_BLOCK_K, inner);
+        for(size_t jj = 0; jj < n; jj += MM_BLOCK_N) {
+            size_t j_to = min(jj + MM_BLOCK_N, n);
+            size_t full_j_to = jj + (j_to - jj) / MM_TILE_COLS * MM_TILE_COLS;
+            size_t i = row_from;
+            for(; i + MM_TILE_ROWS <= row_to; i += MM_TILE_ROWS) {
+                for(size_t j = jj; j < full_j_to; j += MM_TILE_COLS) mm_tile(a, b, c, i, j, kk, k_to);
+                mm_edge(a, b, c, i, i + MM_TILE_ROWS, full_j_to, j_to, kk, k_to);
+            }
+            mm_edge(a, b, c, i, row_to, jj, j_to, kk, k_to);
+        }
+    }
+}
+
+//a * b
+RRMatrix* matmul(const RRMatrix& a, const RRMatrix& b) {
+    if(a.cols != b.rows) {
+        rr_runtime_error("Cannot multiply a "s + to_string(a.rows) + "x" + to_string(a.cols) + " Matrix by a " + to_string(b.rows) + "x" + to_string(b.cols) + " Matrix");
+    }
+    RRMatrix* c = new RRMatrix(a.rows, b.cols);
+    size_t work = a.rows * a.cols * b.cols;
+    size_t nthreads = min((size_t) thread::hardware_concurrency(), min(work / MM_MIN_PARALLEL_WORK, a.rows / MM_TILE_ROWS));
+    if(nthreads <= 1) {
+        matmul_rows(a, b, *c, 0, a.rows);
+        return c;
+    }
+    //split on whole tiles, so only the last thread gets edge rows
+    size_t tiles = a.rows / MM_TILE_ROWS;
+    vector<thread> workers;
+    for(size_t t = 0; t < nthreads; t++) {
+        size_t from = tiles * t / nthreads * MM_TILE_ROWS;
+        size_t to = t + 1 == nthreads ? a.rows : tiles * (t + 1) / nthreads * MM_TILE_ROWS;
+        workers.push_back(thread(matmul_rows, cref(a), cref(b), ref(*c), from, to));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+    return c;
+}
+
+RRMatrix* transpose(const RRMatrix& a) {
+    RRMatrix* res = new RRMatrix(a.cols, a.rows);
+    for(size_t ii = 0; ii < a.rows; ii += TRANSPOSE_BLOCK) {
+        for(size_t jj = 0; jj < a.cols; jj += TRANSPOSE_BLOCK) {
+            for(size_t i = ii; i < min(ii + TRANSPOSE_BLOCK, a.rows); i++) {
+                for(size_t j = jj; j < min(jj + TRANSPOSE_BLOCK, a.cols); j++) res->at(j, i) = a.at(i, j);
+            }
+        }
+    }
+    return res;
+}
+
+RRMatrix* identity(size_t n) {
+    RRMatrix* res = new RRMatrix(n, n);
+    for(size_t i = 0; i < n; i++) res->at(i, i) = 1;
+    return res;
+}
+
+void check_square(const RRMatrix& a, const string& what) {
+    if(a.rows != a.cols) rr_runtime_error(what + " needs a square Matrix, got "s + to_string(a.rows) + "x" + to_string(a.cols));
+}
+
+//LU decomposition with partial pivoting, in place: afterwards `lu` holds U on and above the diagonal,
+// and L (with an implied unit diagonal) below it; row i of the result came from row perm[i] of the input
+//returns false if the matrix is singular
+bool lu_decompose(RRMatrix& lu, vector<size_t>& perm, int& sign) {
+    size_t n = lu.rows;
+    perm.resize(n);
+    for(size_t i = 0; i < n; i++) perm[i] = i;
+    sign = 1;
+    for(size_t k = 0; k < n; k++) {
+        size_t pivot = k;
+        for(size_t i = k + 1; i < n; i++) {
+            if(fabs(lu.at(i, k)) > fabs(lu.at(pivot, k))) pivot = i;
+        }
+        if(lu.at(pivot, k) == 0) return false;
+        if(pivot != k) {
+            swap_ranges(lu.row(k), lu.row(k) + n, lu.row(pivot));
+            swap(perm[k], perm[pivot]);
+            sign = -sign;
+        }
+        double* k_row = lu.row(k);
+        for(size_t i = k + 1; i < n; i++) {
+            double* i_row = lu.row(i);
+            double factor = i_row[k] / k_row[k];
+            i_row[k] = factor;
+            for(size_t j = k + 1; j < n; j++) i_row[j] -= factor * k_row[j];
+        }
+    }
+    return true;
+}
+
+//x such that a * x = b
+RRMatrix* solve(const RRMatrix& a, const RRMatrix& b) {
+    check_square(a, "solve");
+    if(b.rows != a.rows) rr_runtime_error("solve needs a right hand side with "s + to_string(a.rows) + " rows");
+    RRMatrix lu = a;
+    vector<size_t> perm;
+    int sign;
+    if(!lu_decompose(lu, perm, sign)) rr_runtime_error("Matrix is singular");
+    size_t n = a.rows;
+    size_t m = b.cols;
+    RRMatrix* x = new RRMatrix(n, m);
+    for(size_t i = 0; i < n; i++) copy(b.row(perm[i]), b.row(perm[i]) + m, x->row(i));
+    //forward substitution with L, then back substitution with U; a whole row of right hand sides at a time
+    for(size_t i = 0; i < n; i++) {
+        double* x_row = x->row(i);
+        for(size_t k = 0; k < i; k++) {
+            double factor = lu.at(i, k);
+            const double* k_row = x->row(k);
+            for(size_t j = 0; j < m; j++) x_row[j] -= factor * k_row[j];
+        }
+    }
+    for(size_t i = n; i-- > 0;) {
+        double* x_row = x->row(i);
+        for(size_t k = i + 1; k < n; k++) {
+            double factor = lu.at(i, k);
+            const double* k_row = x->row(k);
+            for(size_t j = 0; j < m; j++) x_row[j] -= factor * k_row[j];
+        }
+        for(size_t j = 0; j < m; j++) x_row[j] /= lu.at(i, i);
+    }
+    return x;
+}
+
+double determinant(const RRMatrix& a) {
+    check_square(a, "det");
+    RRMatrix lu = a;
+    vector<size_t> perm;
+    int sign;
+    if(!lu_decompose(lu, perm, sign)) return 0;
+    double det = sign;
+    for(size_t i = 0; i < a.rows; i++) det *= lu.at(i, i);
+    return det;
+}
+
+//lower triangular L with a = L * t(L); a has to be symmetric positive definite
+RRMatrix* cholesky(const RRMatrix& a) {
+    check_square(a, "chol");
+    size_t n = a.rows;
+    RRMatrix* l = new RRMatrix(n, n);
+    for(size_t j = 0; j < n; j++) {
+        double diag = a.at(j, j);
+        for(size_t k = 0; k < j; k++) diag -= l->at(j, k) * l->at(j, k);
+        if(!(diag > 0)) {
+            delete l;
+            rr_runtime_error("Matrix is not positive definite");
+        }
+        l->at(j, j) = sqrt(diag);
+        for(size_t i = j + 1; i < n; i++) {
+            double sum = a.at(i, j);
+            for(size_t k = 0; k < j; k++) sum -= l->at(i, k) * l->at(j, k);
+            l->at(i, j) = sum / l->at(j, j);
+        }
+    }
+    return l;
+}
+
+//thin QR decomposition by Householder reflections: a (m x n, m >= n) = q (m x n) * r (n x n),
+// with orthonormal columns in q and an upper triangular r
+void qr_decompose(const RRMatrix& a, RRMatrix*& q, RRMatrix*& r) {
+    size_t m = a.rows;
+    size_t n = a.cols;
+    if(m < n) rr_runtime_error("qr needs a Matrix with at least as many rows as columns");
+    RRMatrix work = a;
+    vector<vector<double>> reflectors(n);
+    for(size_t k = 0; k < n; k++) {
+        //reflector v that maps column k (from row k down) onto a multiple of the k-th unit vector
+        vector<double>& v = reflectors[k];
+        v.assign(m - k, 0);
+        double norm = 0;
+        for(size_t i = k; i < m; i++) norm += work.at(i, k) * work.at(i, k);
+        norm = sqrt(norm);
+        if(norm == 0) continue;
+        double alpha = work.at(k, k) > 0 ? -norm : norm;
+        for(size_t i = k; i < m; i++) v[i - k] = work.at(i, k);
+        v[0] -= alpha;
+        double v_norm = 0;
+        for(size_t i = 0; i < v.size(); i++) v_norm += v[i] * v[i];
+        v_norm = sqrt(v_norm);
+        for(size_t i = 0; i < v.size(); i++) v[i] /= v_norm;
+        //work = (I - 2vv') * work, for the columns that are left
+        for(size_t j = k; j < n; j++) {
+            double dot = 0;
+            for(size_t i = k; i < m; i++) dot += v[i - k] * work.at(i, j);
+            for(size_t i = k; i < m; i++) work.at(i, j) -= 2 * v[i - k] * dot;
+        }
+    }
+    r = new RRMatrix(n, n);
+    for(size_t i = 0; i < n; i++) {
+        for(size_t j = i; j < n; j++) r->at(i, j) = work.at(i, j);
+    }
+    //q is the product of the reflections, applied to the first n columns of the identity
+    q = new RRMatrix(m, n);
+    for(size_t i = 0; i < n; i++) q->at(i, i) = 1;
+    for(size_t k = n; k-- > 0;) {
+        vector<double>& v = reflectors[k];
+        for(size_t j = 0; j < n; j++) {
+            double dot = 0;
+            for(size_t i = k; i < m; i++) dot += v[i - k] * q->at(i, j);
+            for(size_t i = k; i < m; i++) q->at(i, j) -= 2 * v[i - k] * dot;
+        }
+    }
+}
@@ -1,26 +1,65 @@
 #include <iostream>
 #include <string>
 
+#define RR_ALLOC_HOOK //the interpreter's `new` and `delete` go through mem_stats.h
+
 #include "tokenizer.h"
 #include "parser.h"
 #include "environment.h"
+#include "server.h"
+#include "ast_cache.h"
+#include "session.h"
+#include "repl.h"
 
 using namespace std;
 
 bool DEBUG_MAIN = false;
 
-int main(int argc, char** argv) {
-    if(argc > 1) DEBUG_MAIN = true;
-    init_datatypes();
+//what `--profile`, `--sample` and `--mem-stats` report on
+struct RunReports {
+    ASTNode* compiled;
+    Env* env;
+    string sample_path;
+    bool mem_report;
+    long long eval_start;
+} run_reports = {nullptr, nullptr, "", false, 0};
 
-    string source;
-    string line;
-    while(getline(cin, line)) {
-        source += line;
-        source += "\n";
+//print the `--profile` and `--mem-stats` reports and write the `--sample` stacks, if asked for;
+// only the first call does anything
+void write_run_reports() {
+    if(run_reports.compiled == nullptr) return;
+    long long eval_ns = prof_now_ns() - run_reports.eval_start;
+    if(rr_sampling) stop_sampling();
+    rr_out.flush();
+    if(rr_profiling) {
+        vector<ProfileRow> nodes;
+        vector<ProfileRow> builtins;
+        run_reports.compiled->collect_profile(nodes);
+        run_reports.env->collect_profile(builtins);
+        print_profile_report(nodes, builtins, eval_ns);
     }
-    if(DEBUG_MAIN) cout << "--start source code:\n" << source << "\n--end source code." << endl;
+    if(run_reports.mem_report) {
+        vector<MemRow> values;
+        run_reports.env->collect_mem_stats(values);
+        print_mem_report(values);
+    }
+    string& path = run_reports.sample_path;
+    run_reports.compiled = nullptr;
+    if(path.empty()) return;
+    FILE* out = fopen(path.c_str(), "w");
+    if(out == nullptr) {
+        cerr << "--sample: cannot open '" << path << "' for writing" << endl;
+        return;
+    }
+    write_folded_stacks(out, sample_frame_name);
+    fclose(out);
+    cerr << "--sample: " << sample_log.samples << " samples written to '" << path << "'";
+    if(sample_log.dropped > 0) cerr << " (" << sample_log.dropped << " dropped)";
+    cerr << endl;
+}
 
+//tokenize and parse `source`, and save the tree to the cache if there is one
+ASTNode* parse_source(string& source, Env& env, string& cache_dir) {
     vector<Token> ts = Tokenizer::from_source(source).tokenize();
     
     if(DEBUG_MAIN) {
@@ -31,9 +70,24 @@ int main(int argc, char** argv) {
         cout << "\n--end listing tokens." << endl;
     }
 
-    Env env = Env();
-    Env::init_with_default(env);
+    MemCategory category(MEM_AST);
     ASTNode* compiled = Parser::from_tokens(ts).parse(env);
+    if(!cache_dir.empty()) save_cached_ast(cache_dir, source, compiled);
+    return compiled;
+}
+
+//parse and evaluate `source`, printing what was asked for; errors in the program are thrown as `RRError`
+void run_source(string& source, Env& env, string& sample_path, bool mem_report, string& cache_dir) {
+    {
+        MemCategory category(MEM_ENV);
+        Env::init_with_default(env);
+    }
+    ASTNode* compiled = nullptr;
+    if(!cache_dir.empty()) {
+        MemCategory category(MEM_AST);
+        compiled = load_cached_ast(cache_dir, source);
+    }
+    if(compiled == nullptr) compiled = parse_source(source, env, cache_dir);
 
     if(DEBUG_MAIN) {
         cout << "--start print AST:\n" << endl;
@@ -42,9 +96,96 @@ int main(int argc, char** argv) {
     }
 
     if(DEBUG_MAIN) cout << "--start eval:\n" << endl;
-    RRObj return_val = compiled->eval(env);
-    cout << return_val << endl;
-    if(DEBUG_MAIN) cout << "\n--end eval." << endl;
+    run_reports = {compiled, &env, sample_path, mem_report, prof_now_ns()};
+    if(!sample_path.empty()) start_sampling();
+    try {
+        RRObj return_val = compiled->eval(env);
+        if(!sample_path.empty()) stop_sampling();
+        rr_out << return_val << '\n';
+    } catch(bad_alloc&) {
+        bool limited = mem_limit_enforced;
+        mem_limit_enforced = false;
+        if(limited) rr_runtime_error("Heap limit of "s + to_string(mem_limit_bytes / 1000000) + " MB reached");
+        rr_runtime_error("Out of memory");
+    }
+    write_run_reports();
+    if(DEBUG_MAIN) {
+        rr_out.flush();
+        cout << "\n--end eval." << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    //`--profile` reports where time went, `--sample <file>` writes sampled stacks to the file,
+    // `--mem-stats` reports memory use, `--max-heap <MB>` limits it; any other arguments turn on debug output
+    //`--serve <socket>` runs a server instead (with `--workers N` threads), and `--connect <socket>` sends it stdin
+    //`--cache <dir>` keeps parsed scripts in the directory, so running the same script again skips parsing
+    //`--session <file>` runs the file, then again whenever it's saved, evaluating only the statements an edit affects
+    //`--repl` evaluates statements as they're typed in, keeping variables between them
+    //`--no-jit` keeps hot Vec arithmetic in the interpreter, `--perf-map` names its compiled code for `perf`
+    string sample_path;
+    string cache_dir;
+    string serve_path;
+    string connect_path;
+    string session_path;
+    int workers = 0;
+    bool mem_report = false;
+    bool repl = false;
+    for(int i = 1; i < argc; i++) {
+        if(string(argv[i]) == "--profile") rr_profiling = true;
+        else if(string(argv[i]) == "--mem-stats") rr_mem_stats = mem_report = true;
+        else if(string(argv[i]) == "--max-heap" && i + 1 < argc) {
+            rr_mem_stats = mem_limit_enforced = true;
+            mem_limit_bytes = atof(argv[++i]) * 1e6;
+        }
+        else if(string(argv[i]) == "--sample" && i + 1 < argc) sample_path = argv[++i];
+        else if(string(argv[i]) == "--serve" && i + 1 < argc) serve_path = argv[++i];
+        else if(string(argv[i]) == "--workers" && i + 1 < argc) workers = atoi(argv[++i]);
+        else if(string(argv[i]) == "--connect" && i + 1 < argc) connect_path = argv[++i];
+        else if(string(argv[i]) == "--cache" && i + 1 < argc) cache_dir = argv[++i];
+        else if(string(argv[i]) == "--session" && i + 1 < argc) session_path = argv[++i];
+        else if(string(argv[i]) == "--repl") repl = true;
+        else if(string(argv[i]) == "--no-jit") rr_jit = false;
+        else if(string(argv[i]) == "--perf-map") rr_jit_perf_map = true;
+        else DEBUG_MAIN = true;
+    }
+    //the reports are made for one run of one script; a server's workers would share the counters, and never print them
+    const char* mode = !serve_path.empty() ? "--serve" : !connect_path.empty() ? "--connect"
+        : !session_path.empty() ? "--session" : repl ? "--repl" : nullptr;
+    if(mode != nullptr && (rr_profiling || rr_mem_stats || !sample_path.empty())) {
+        fprintf(stderr, "%s: --profile, --sample, --mem-stats and --max-heap only work when running a script directly\n", mode);
+        return 1;
+    }
+    if(!serve_path.empty()) {
+        init_datatypes();
+        return serve(serve_path, workers);
+    }
+    if(!session_path.empty()) return run_session(session_path);
+    if(repl) return run_repl();
+
+    string source;
+    string line;
+    while(getline(cin, line)) {
+        source += line;
+        source += "\n";
+    }
+    if(DEBUG_MAIN) cout << "--start source code:\n" << source << "\n--end source code." << endl;
+    if(!connect_path.empty()) return serve_client(connect_path, source);
+
+    Env env = Env();
+    try {
+        init_datatypes();
+        run_source(source, env, sample_path, mem_report, cache_dir);
+    } catch(RRError& error) {
+        mem_limit_enforced = false;
+        report_error(error);
+        write_run_reports(); //the reports cover the run up to the error
+        exit(1);
+    } catch(exception& error) {
+        report_error(RRError(false, error.what()));
+        write_run_reports();
+        exit(1);
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,49 @@
+// Read-only access to a whole file through mmap
+
+#pragma once
+
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Structs
+*/
+
+//the contents of a file, mapped into memory; pages are only read in when touched
+struct MappedFile {
+    const char* data;
+    size_t size;
+
+    MappedFile(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) rr_runtime_error("Couldn't open file '"s + path + "'");
+        struct stat st;
+        if(fstat(fd, &st) != 0) {
+            close(fd);
+            rr_runtime_error("Couldn't read file '"s + path + "'");
+        }
+        size = st.st_size;
+        data = nullptr;
+        if(size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped == MAP_FAILED) {
+                close(fd);
+                rr_runtime_error("Couldn't map file '"s + path + "'");
+            }
+            data = (const char*) mapped;
+        }
+        close(fd);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        if(data != nullptr) munmap((void*) data, size);
+    }
+};
@@ -0,0 +1,212 @@
+// Memory accounting: counts heap allocations by what they were made for, and reports memory use
+// Enabled by running with `--mem-stats`; the report is printed to stderr when the program ends.
+// `--max-heap <MB>` also counts allocations, and stops the program when the live heap would grow past the limit.
+// In programs that define RR_ALLOC_HOOK before including the interpreter (the interpreter and its benchmarks), every
+// `new` goes through the hook below, which takes small blocks from the pools in pool.h. librr doesn't define it, so
+// a program embedding RR keeps its own `new` and `delete`, and memory isn't counted there.
+// When accounting is off, it's only a check of `rr_mem_stats` on the way to the pools or malloc.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "datatypes.h"
+#include "pool.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//what an allocation was made for; values of type `t` are category `MEM_TYPES + t`
+enum MemCategoryId {
+    MEM_INTERPRETER, //anything not made for a parse, the environment or a builtin
+    MEM_AST,
+    MEM_ENV,
+    MEM_TYPES
+};
+const int MEM_MAX_CATEGORIES = MEM_TYPES + 32;
+
+bool rr_mem_stats = false;
+//with `--max-heap`, allocations on the interpreter thread fail with `bad_alloc` instead of growing the live heap past this
+long long mem_limit_bytes = 0;
+thread_local bool mem_limit_enforced = false;
+
+/*
+    Structs
+*/
+
+//live and peak heap use, and allocations made per category
+//sizes are what the pool or malloc actually reserved for each block
+struct MemCounters {
+    atomic<unsigned long long> allocs[MEM_MAX_CATEGORIES];
+    atomic<unsigned long long> bytes[MEM_MAX_CATEGORIES];
+    atomic<long long> live_bytes;
+    atomic<long long> live_blocks;
+    atomic<long long> peak_bytes;
+};
+
+MemCounters mem_counters;
+//category of the allocations being made now; worker threads of a builtin share it
+atomic<int> mem_category(MEM_INTERPRETER);
+
+//allocations made while this lives are counted under `category`
+struct MemCategory {
+    int outer;
+
+    MemCategory(int category) : outer(mem_category.load(memory_order_relaxed)) {
+        mem_category.store(category, memory_order_relaxed);
+    }
+    ~MemCategory() {
+        mem_category.store(outer, memory_order_relaxed);
+    }
+};
+
+/*
+    Functions
+*/
+
+int mem_category_of_type(int type) {
+    return MEM_TYPES + type;
+}
+
+string mem_category_name(int category) {
+    if(category == MEM_INTERPRETER) return "interpreter";
+    if(category == MEM_AST) return "AST";
+    if(category == MEM_ENV) return "Env";
+    return single_type_of(category - MEM_TYPES);
+}
+
+//bytes actually reserved for block `ptr`
+long long block_size(void* ptr) {
+    return pool_owns(ptr) ? pool_block_size(ptr) : malloc_usable_size(ptr);
+}
+
+void count_alloc(void* ptr) {
+    long long size = block_size(ptr);
+    int category = mem_category.load(memory_order_relaxed);
+    mem_counters.allocs[category].fetch_add(1, memory_order_relaxed);
+    mem_counters.bytes[category].fetch_add(size, memory_order_relaxed);
+    mem_counters.live_blocks.fetch_add(1, memory_order_relaxed);
+    long long live = mem_counters.live_bytes.fetch_add(size, memory_order_relaxed) + size;
+    long long peak = mem_counters.peak_bytes.load(memory_order_relaxed);
+    while(live > peak && !mem_counters.peak_bytes.compare_exchange_weak(peak, live, memory_order_relaxed)) {}
+}
+
+void count_free(void* ptr) {
+    mem_counters.live_blocks.fetch_sub(1, memory_order_relaxed);
+    mem_counters.live_bytes.fetch_sub(block_size(ptr), memory_order_relaxed);
+}
+
+//worker threads of a builtin are never stopped by the heap limit; the next allocation on the interpreter thread is
+void* counted_alloc(size_t size) {
+    if(rr_mem_stats && mem_limit_enforced && mem_counters.live_bytes.load(memory_order_relaxed) + (long long) size > mem_limit_bytes) {
+        throw bad_alloc();
+    }
+    void* ptr = pool_alloc(size);
+    if(ptr == nullptr) ptr = malloc(size == 0 ? 1 : size);
+    if(ptr == nullptr) throw bad_alloc();
+    if(rr_mem_stats) count_alloc(ptr);
+    return ptr;
+}
+
+void counted_free(void* ptr) {
+    if(ptr == nullptr) return;
+    if(rr_mem_stats) count_free(ptr);
+    if(pool_owns(ptr)) pool_free(ptr);
+    else free(ptr);
+}
+
+//resident memory of the process right now, in bytes
+long long current_rss_bytes() {
+    long long pages = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if(statm == nullptr) return 0;
+    if(fscanf(statm, "%lld %lld", &pages, &resident) != 2) resident = 0;
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+long long peak_rss_bytes() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss * 1024LL; //in KB on Linux
+}
+
+//a line of the report on values: how many values of a type there are, and their heap bytes
+struct MemRow {
+    string what;
+    unsigned long long count;
+    long long bytes;
+};
+
+//print memory use, allocations made per category, and `values` still held by variables
+void print_mem_report(vector<MemRow>& values) {
+    fprintf(stderr, "--mem-stats: peak RSS %.3f MB, RSS at exit %.3f MB\n", peak_rss_bytes() / 1e6, current_rss_bytes() / 1e6);
+    fprintf(stderr, "heap: %.3f MB in %lld blocks live at exit, peak %.3f MB\n\n",
+        mem_counters.live_bytes.load() / 1e6, mem_counters.live_blocks.load(), mem_counters.peak_bytes.load() / 1e6);
+    fprintf(stderr, "allocations, by what they were made for:\n");
+    fprintf(stderr, "%12s %12s  %s\n", "count", "MB", "made for");
+    for(int c = 0; c < MEM_MAX_CATEGORIES; c++) {
+        unsigned long long allocs = mem_counters.allocs[c].load();
+        if(allocs == 0) continue;
+        fprintf(stderr, "%12llu %12.3f  %s\n", allocs, mem_counters.bytes[c].load() / 1e6, mem_category_name(c).c_str());
+    }
+    fprintf(stderr, "\nvalues held by variables at exit, by type:\n");
+    fprintf(stderr, "%12s %12s  %s\n", "count", "MB", "type");
+    for(int i = 0; i < values.size(); i++) {
+        fprintf(stderr, "%12llu %12.3f  %s\n", values[i].count, values[i].bytes / 1e6, values[i].what.c_str());
+    }
+    fflush(stderr);
+}
+
+/*
+    Allocation hook
+    replaces the global `new` and `delete`; aligned versions are left to the standard library, and never pooled
+*/
+
+#ifdef RR_ALLOC_HOOK
+
+void* operator new(size_t size) {
+    return counted_alloc(size);
+}
+void* operator new[](size_t size) {
+    return counted_alloc(size);
+}
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    try {
+        return counted_alloc(size);
+    } catch(bad_alloc&) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    try {
+        return counted_alloc(size);
+    } catch(bad_alloc&) {
+        return nullptr;
+    }
+}
+void operator delete(void* ptr) noexcept {
+    counted_free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    counted_free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+
+#endif
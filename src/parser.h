@@ -5,12 +5,14 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 
 #include "datatypes.h"
 #include "rr_obj.h"
 #include "tokenizer.h"
 #include "environment.h"
 #include "rr_error.h"
+#include "sampler.h"
 
 using namespace std;
 
@@ -38,9 +40,31 @@ struct ASTNode;
 ASTNode* apply_evaluate_with_args(ASTNode* root, ASTNode* args);
 ASTNode* apply_index(ASTNode* root, ASTNode* index);
 
+//values replaced by `=` while operands evaluated before it were held; those operands may still refer to them,
+// so they're released before the next statement instead
+thread_local vector<RRObj> rr_replaced;
+thread_local int rr_held_operands = 0; //evaluations holding operands while evaluating a later one
+
+void release_replaced() {
+    if(rr_held_operands == 0) rr_replaced.clear();
+}
+
 /*
     Structs
 */
+
+//counts the evaluation's operands as held while it's in scope
+struct OperandHold {
+    OperandHold() { rr_held_operands++; }
+    ~OperandHold() { rr_held_operands--; }
+};
+
+//a tree of `+`/`*` ops, in postorder: operators, and the leaves to be evaluated
+struct FusedTree {
+    vector<FuseInstr> program;
+    vector<ASTNode*> leaves;
+};
+
 struct ASTNode {
     ASTType type;
     vector<ASTNode*> children;
@@ -48,6 +72,11 @@ struct ASTNode {
         RRObj literal;
         string symbol;
     };
+    int line = 0; //where the node starts in the source
+    int col = 0;
+    ProfileCounter prof;
+    FuseOpCode fuse_op = FUSE_LEAF; //for `+` and `*` ops, so they're told apart without comparing symbols
+    atomic<FusedTree*> fused = {nullptr}; //the tree of `+`/`*` ops rooted here, compiled on its first evaluation
 
     ASTNode(ASTType type) {
         this->type = type;
@@ -57,22 +86,26 @@ struct ASTNode {
         if(!rr_obj.owner) parse_error("Trying to insert a reference object into AST literal");
         this->type = type;
         this->children = {};
-        this->literal = rr_obj;
+        new (&this->literal) RRObj(rr_obj);
     }
     ASTNode(ASTType type, vector<ASTNode*> children) {
         this->type = type;
         this->children = children;
+        if(!children.empty()) locate_at(children[0]);
     }
     ASTNode(ASTType type, vector<ASTNode*> children, string& symbol_name) {
         this->type = type;
         this->children = children;
         new (&this->symbol) string(symbol_name);
+        if(type == ASTType::OP && fusable_op(symbol_name)) fuse_op = fuse_op_of(symbol_name);
     }
     ASTNode(ASTType type, string& symbol_name) {
         this->type = type;
         new (&this->symbol) string(symbol_name);
+        if(type == ASTType::OP && fusable_op(symbol_name)) fuse_op = fuse_op_of(symbol_name);
     }
     ~ASTNode() {
+        delete fused.load();
         switch(type) {
             case ASTType::LITERAL: literal.~RRObj(); break;
             case ASTType::FUN: symbol.~string(); break;
@@ -108,16 +141,48 @@ struct ASTNode {
         return *this;
     }
 
+    //take the source position of `node`
+    void locate_at(ASTNode* node) {
+        line = node->line;
+        col = node->col;
+    }
+
     RRObj eval(Env& env) {
+        if(!rr_profiling && !rr_sampling) return eval_node(env);
+        return eval_instrumented(env);
+    }
+
+    //evaluate while profiling and/or sampling
+    RRObj eval_instrumented(Env& env) {
+        return instrumented([&]() { return eval_node(env); });
+    }
+
+    //run `eval_this`, which evaluates this node, counted for the profiler and/or sampler
+    template<typename F>
+    RRObj instrumented(F eval_this) {
+        if(!rr_sampling) {
+            NodeTimer timer(prof);
+            return eval_this();
+        }
+        SampleFrame frame(this);
+        if(!rr_profiling) return eval_this();
+        NodeTimer timer(prof);
+        return eval_this();
+    }
+
+    RRObj eval_node(Env& env) {
         switch (type) {
             case ASTType::STATEMENT: {
+                if(children.empty()) return RRObj(); //an empty program, or `{}`
                 for(int i = 0; i < children.size()-1; i++) {
+                    release_replaced();
                     children[i]->eval(env);
                 }
+                release_replaced();
                 return children.back()->eval(env);
             }; break;
             case ASTType::LITERAL: {
-                return literal.to_owned();
+                return literal; //copy constructor gives an owned deep clone
             }; break;
             case ASTType::VAR: {
                 return env.get_var(symbol); //will give a ref
@@ -130,20 +195,23 @@ struct ASTNode {
                     return RRObj(symbol);
                 } else {
                     //it's a regular op
-                    if(symbol == "=") {
-                        // return env.assign_var(children[0]->symbol, children[1]->eval(env));
+                    if(symbol == "=" && children.size() == 2) {
+                        if(children[0]->type == ASTType::VAR) {
+                            //the variable is only made once there's a value for it, so a failed assignment leaves none behind
+                            RRObj val = children[1]->eval(env);
+                            return assign(children[0]->eval_mut(env), val);
+                        }
                         RRObj& obj = children[0]->eval_mut(env);
-                        obj = children[1]->eval(env).to_owned();
-                        return obj.ref();
+                        RRObj val = eval_held(children[1], env); //`obj` may be inside a value the right side replaces
+                        return assign(obj, val);
+                    } else if(is_arith()) {
+                        return eval_arith(env);
                     } else {
                         vector<RRObj> args;
                         vector<RRDataType> types;
-                        for(int i = 0; i < children.size(); i++) {
-                            args.push_back(children[i]->eval(env));
-                            types.push_back(args[i].type);
-                        }
+                        eval_args(symbol, children, args, types, env);
                         RRFun* fun = env.get_fun(symbol, types);
-                        return fun->cpp_fun(args, env);
+                        return fun->call(args, env);
                     }
                 }
             }; break;
@@ -158,8 +226,12 @@ struct ASTNode {
             case ASTType::CSV: {
                 //return a list RRObj
                 RRObj list_obj = RRObj(new vector<RRObj>());
+                list_obj.data_list->reserve(children.size());
                 for(int i = 0; i < children.size(); i++) {
-                    list_obj.data_list->push_back(children[i]->eval(env));
+                    //a List owns all of its elements, so values in it are never released from under it
+                    RRObj elem = children[i]->eval(env);
+                    elem.to_owned();
+                    list_obj.data_list->push_back(move(elem));
                 }
                 return list_obj;//.move();
             }; break;
@@ -172,40 +244,161 @@ struct ASTNode {
                 //evaluate a function call
                 if(children.size() != 2) rr_runtime_error("Evaluate node doesn't have exactly 2 children");
                 RRObj fn_name = children[0]->eval(env); //assume that returned a literal string = name of function
-                //assume that second child is a CSV node
-                RRObj args = children[1]->eval(env);
-                if(!(args.type == RRDataType("List"))) rr_runtime_error("A function is given non argument list");
+                if(children[1]->type != ASTType::CSV) rr_runtime_error("A function is given non argument list");
                 
+                vector<RRObj> args;
                 vector<RRDataType> types;
-                for(int i = 0; i < args.data_list->size(); i++) {
-                    types.push_back((*args.data_list)[i].type);
-                }
+                eval_args(*fn_name.data_str, children[1]->children, args, types, env);
                 RRFun* fun = env.get_fun(*fn_name.data_str, types);
-                return fun->cpp_fun(*args.data_list, env);
+                return fun->call(args, env);
             }; break;
             case ASTType::INDEX: {
                 //evaluate a function call
                 if(children.size() != 2) rr_runtime_error("Evaluate node doesn't have exactly 2 children");
-                RRObj collection = children[0]->eval(env); //assume that returned a literal string = name of function
-                //assume that second child is a CSV node
-                RRObj index = children[1]->eval(env);
-
-                //TODO: i just directly index; call an `index` function instead
+                //collection and index are moved into `args`, so temporaries (like views) aren't copied
+                vector<RRObj> args;
+                args.reserve(2);
+                args.push_back(children[0]->eval(env));
+                args.push_back(eval_held(children[1], env));
 
                 string name = "index";
-                vector<RRDataType> dts = {collection.type, index.type};
+                vector<RRDataType> dts = {args[0].type, args[1].type};
                 RRFun* fun = env.get_fun(name, dts);
-                vector<RRObj> args = {collection, index};
-                return fun->cpp_fun(args, env);
+                return fun->call(args, env);
             }; break;
         }
         rr_runtime_error(string("Invalid statement encountered: ")+to_string(type));
         exit(1);
     }
 
+    //evaluate `arg_nodes` as arguments to function `fn_name`, filling `args` and their `types`
+    //lazy params are not evaluated; they are given as `Expr` objects instead
+    static void eval_args(string& fn_name, vector<ASTNode*>& arg_nodes, vector<RRObj>& args, vector<RRDataType>& types, Env& env) {
+        vector<bool>* lazy = env.get_lazy_params(fn_name);
+        args.reserve(arg_nodes.size());
+        types.reserve(arg_nodes.size());
+        for(int i = 0; i < arg_nodes.size(); i++) {
+            if(lazy != nullptr && i < lazy->size() && (*lazy)[i]) {
+                RRObj expr = RRObj(RRDataType("Expr"));
+                expr.data_expr = arg_nodes[i]; //the AST is owned by the parser, so never released
+                args.push_back(expr);
+            } else {
+                args.push_back(i == 0 ? arg_nodes[i]->eval(env) : eval_held(arg_nodes[i], env));
+            }
+            types.push_back(args[i].type);
+        }
+    }
+
+    //store `val` in `obj`, which an `=` is assigning to
+    static RRObj assign(RRObj& obj, RRObj& val) {
+        val.to_owned(); //a copy, if `val` refers into the value being replaced
+        if(rr_held_operands > 0) rr_replaced.push_back(move(obj)); //operands held above may refer into it
+        RRObj replaced = move(obj); //otherwise released when this returns
+        obj = val;
+        val.owner = false; //`obj` took over the data
+        return obj.ref();
+    }
+
+    //evaluate `node` while the operands evaluated before it are kept; assignments in it won't release what they refer to
+    static RRObj eval_held(ASTNode* node, Env& env) {
+        OperandHold hold;
+        return node->eval(env);
+    }
+
+    //a `+` or `*` op with both operands
+    bool is_arith() {
+        return fuse_op != FUSE_LEAF && children.size() == 2;
+    }
+
+    //the tree of `+`/`*` ops rooted at this node, in postorder: operators, and leaves to be evaluated
+    void compile_arith(vector<FuseInstr>& program, vector<ASTNode*>& leaves) {
+        for(int i = 0; i < 2; i++) {
+            ASTNode* child = children[i];
+            if(child->is_arith()) {
+                child->compile_arith(program, leaves);
+            } else {
+                program.push_back({FUSE_LEAF, (int) leaves.size()});
+                leaves.push_back(child);
+            }
+        }
+        program.push_back({fuse_op, -1});
+    }
+
+    //compiled once; threads serving requests may evaluate the same tree, so the first one to finish keeps its copy
+    FusedTree* fused_tree() {
+        FusedTree* tree = fused.load(memory_order_acquire);
+        if(tree != nullptr) return tree;
+        MemCategory category(MEM_AST);
+        tree = new FusedTree();
+        compile_arith(tree->program, tree->leaves);
+        FusedTree* other = nullptr;
+        if(fused.compare_exchange_strong(other, tree, memory_order_acq_rel)) return tree;
+        delete tree;
+        return other;
+    }
+
+    //evaluate a tree of `+`/`*` ops; when its first operand is a Vec, the whole tree runs as one fused loop
+    //otherwise it's evaluated node by node, like any other op
+    RRObj eval_arith(Env& env) {
+        FusedTree* tree = fused_tree();
+        RRObj first = tree->leaves[0]->eval(env);
+        if(first.type.type != DATATYPE_VEC) return eval_arith_nodes(first, env);
+
+        vector<RRObj> leaves;
+        leaves.reserve(tree->leaves.size());
+        leaves.push_back(move(first));
+        for(int i = 1; i < tree->leaves.size(); i++) leaves.push_back(eval_held(tree->leaves[i], env));
+
+        size_t len;
+        bool floats;
+        if(fusable_leaves(leaves, len, floats)) {
+            RRObj res = RRObj(RRDataType("Vec"));
+            MemCategory category(mem_category_of_type(res.type.type));
+            res.data_vec = fused_vec(tree->program, leaves, len, floats);
+            return res.move();
+        }
+
+        vector<FuseInstr>& program = tree->program;
+        vector<RRObj> stack;
+        for(int pc = 0; pc < program.size(); pc++) {
+            if(program[pc].op == FUSE_LEAF) {
+                stack.push_back(move(leaves[program[pc].leaf]));
+                continue;
+            }
+            vector<RRObj> args;
+            args.reserve(2);
+            args.push_back(move(stack[stack.size() - 2]));
+            args.push_back(move(stack[stack.size() - 1]));
+            stack.pop_back();
+            stack.pop_back();
+            stack.push_back(call_arith(program[pc].op, args, env));
+        }
+        return move(stack.back());
+    }
+
+    //evaluate this tree of `+`/`*` ops node by node; its leftmost operand was evaluated already, to `first`
+    RRObj eval_arith_nodes(RRObj& first, Env& env) {
+        vector<RRObj> args;
+        args.reserve(2);
+        ASTNode* lhs = children[0];
+        if(!lhs->is_arith()) args.push_back(move(first));
+        else if(!rr_profiling && !rr_sampling) args.push_back(lhs->eval_arith_nodes(first, env));
+        else args.push_back(lhs->instrumented([&]() { return lhs->eval_arith_nodes(first, env); }));
+        args.push_back(eval_held(children[1], env));
+        return call_arith(fuse_op, args, env);
+    }
+
+    static RRObj call_arith(FuseOpCode op, vector<RRObj>& args, Env& env) {
+        static string add = "+", mul = "*";
+        vector<RRDataType> types = {args[0].type, args[1].type};
+        RRFun* fun = env.get_fun(op == FUSE_ADD ? add : mul, types);
+        return fun->call(args, env);
+    }
+
     RRObj& eval_mut(Env& env) {
         switch (type) {
             case ASTType::STATEMENT: {
+                if(children.empty()) rr_runtime_error("Cannot mutably reference an empty statement");
                 for(int i = 0; i < children.size()-1; i++) {
                     children[i]->eval(env);
                 }
@@ -219,10 +412,17 @@ struct ASTNode {
                 if(children.size() != 2) rr_runtime_error("Evaluate node doesn't have exactly 2 children");
                 RRObj collection = children[0]->eval(env); //assume that returned a literal string = name of function
                 //assume that second child is a CSV node
-                RRObj index = children[1]->eval(env);
+                RRObj index = eval_held(children[1], env);
 
                 //TODO: i just directly index; call an `index` function instead
 
+                //views (slices) can't be assigned into; assigning one to a variable first makes a copy that can
+                if(!(collection.type == RRDataType("List")) || !(index.type == RRDataType("Int"))) {
+                    rr_runtime_error("Can only mutably index into a List with an Int");
+                }
+                if(index.data_int < 0 || index.data_int >= collection.data_list->size()) {
+                    rr_runtime_error("Index out of range: "s + to_string(index.data_int));
+                }
                 return (*collection.data_list)[index.data_int];
             }; break;
             default: rr_runtime_error("Cannot mutably reference a non-variable");
@@ -231,6 +431,32 @@ struct ASTNode {
         exit(1);
     }
 
+    //a short description of the node for the profile report
+    string describe() const {
+        switch(type) {
+            case ASTType::STATEMENT: return "{statement}";
+            case ASTType::LITERAL: return "literal";
+            case ASTType::VAR: return "var " + symbol;
+            case ASTType::FUN: return "fun " + symbol;
+            case ASTType::OP: return "op " + symbol;
+            case ASTType::IF: return "if";
+            case ASTType::CSV: return "a, b, ...";
+            case ASTType::EVALUATE: {
+                if(children[0]->type == ASTType::FUN || children[0]->type == ASTType::OP) return children[0]->symbol + "(...)";
+                return "call";
+            }
+            case ASTType::INDEX: return "[index]";
+            case ASTType::LIST_BUILDER: return "[list]";
+            default: return "node " + to_string(type);
+        }
+    }
+
+    //add a row for every node of this tree that was evaluated
+    void collect_profile(vector<ProfileRow>& rows) const {
+        if(prof.count > 0) rows.push_back({to_string(line) + ":" + to_string(col), describe(), prof});
+        for(int i = 0; i < children.size(); i++) children[i]->collect_profile(rows);
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const ASTNode& node) {
         switch(node.type) {
             case ASTType::LITERAL: {
@@ -281,6 +507,13 @@ struct Parser {
         return Parser { tokens, 0, false };
     }
 
+    //give `node` the source position of token `at`
+    ASTNode* located(ASTNode* node, int at) {
+        node->line = tokens[at].line;
+        node->col = tokens[at].col;
+        return node;
+    }
+
     //parse the whole token list; return a single statement node that holds all code
     ASTNode* parse(Env& env) {
         return parse_block_statement(env);
@@ -342,7 +575,7 @@ struct Parser {
                 case TokenType::T_SYMBOL: {
                     //after the initial expression, should only be infix operators
                     if(env.is_op(tokens[at_elem].t)) {
-                        ASTNode* new_node = new ASTNode(ASTType::OP, {}, tokens[at_elem].t); //read an operator
+                        ASTNode* new_node = located(new ASTNode(ASTType::OP, {}, tokens[at_elem].t), at_elem); //read an operator
                         at_elem++;
                         root = insert_op_into_ast(root, new_node, env);
                     } else {
@@ -373,7 +606,7 @@ struct Parser {
     //parse until `}` is reached; return the resulting AST
     //expect **not** to see `{` as current element
     ASTNode* parse_block_statement(Env& env) {
-        ASTNode* root = new ASTNode(ASTType::STATEMENT, vector<ASTNode*>());
+        ASTNode* root = located(new ASTNode(ASTType::STATEMENT, vector<ASTNode*>()), at_elem);
         while(!done) {
             switch(tokens[at_elem].type) {
                 case TokenType::T_DELIM: {
@@ -419,10 +652,11 @@ struct Parser {
                     return parse_block_statement(env);
                 } else if(tokens[at_elem].t == "[") {
                     //when parsing `[` as an expression, assume it's a list builder, not collection index
+                    int start = at_elem;
                     at_elem++;
                     ASTNode* elements = parse_line(env);
                     if(elements->type != ASTType::CSV) elements = new ASTNode(ASTType::CSV, {elements});
-                    return new ASTNode(ASTType::LIST_BUILDER, {elements});
+                    return located(new ASTNode(ASTType::LIST_BUILDER, {elements}), start);
                 } else if(tokens[at_elem].t == "}") {
                     //expression must not start with a `}`
                     parse_error("Reached end of statement ('}') when expected an expression");
@@ -438,13 +672,13 @@ struct Parser {
             }; break;
             case TokenType::T_LITERAL: {
                 at_elem++;
-                return new ASTNode( ASTType::LITERAL, RRObj(tokens[at_elem-1]) );
+                return located(new ASTNode( ASTType::LITERAL, RRObj(tokens[at_elem-1]) ), at_elem-1);
             }; break;
             case TokenType::T_SYMBOL: {
                 //takes care of: unary ops, function-like op calls, functions, variables, if/else
                 if(tokens[at_elem].t == "if") {
                     at_elem++; //skip `if`
-                    ASTNode* if_statement = new ASTNode(ASTType::IF);
+                    ASTNode* if_statement = located(new ASTNode(ASTType::IF), at_elem-1);
                     if_statement->children.push_back(parse_next_expression(env)); //the condition
                     if_statement->children.push_back(parse_next_expression(env)); //the if block
                     if(tokens[at_elem].t != "else") {
@@ -456,7 +690,7 @@ struct Parser {
                 } else if(tokens[at_elem].t == "else") {
                     parse_error("Cannot read 'else' without 'if'");
                 } else if(env.is_op(tokens[at_elem].t)) {
-                    ASTNode* new_node = new ASTNode(ASTType::OP, tokens[at_elem].t); //read an operator
+                    ASTNode* new_node = located(new ASTNode(ASTType::OP, tokens[at_elem].t), at_elem); //read an operator
                     at_elem++;
                     if(tokens[at_elem].t != "(") {
                         //it's indeed a unary operator usage
@@ -464,15 +698,16 @@ struct Parser {
                     }
                     //else it's a function-like op call
                     return new_node;
-                } else if(env.is_fun(tokens[at_elem].t)) {
-                    ASTNode* new_node = new ASTNode(ASTType::FUN, tokens[at_elem].t); //read a function
+                } else if(env.is_fun(tokens[at_elem].t) && tokens[at_elem + 1].type == TokenType::T_DELIM && tokens[at_elem + 1].t == "(") {
+                    //a builtin's name is only a function when it's called; otherwise it's a variable, so `t = 3` works
+                    ASTNode* new_node = located(new ASTNode(ASTType::FUN, tokens[at_elem].t), at_elem); //read a function
                     at_elem++;
                     // don't assume evaluation
                     return new_node;
                 } else {
                     //assume a variable
                     at_elem++;
-                    return new ASTNode(ASTType::VAR, tokens[at_elem-1].t);
+                    return located(new ASTNode(ASTType::VAR, tokens[at_elem-1].t), at_elem-1);
                 }
             }; break;
             case TokenType::T_NEWLINE: {
@@ -523,8 +758,30 @@ struct Parser {
     Functions
 */
 
+//evaluate an `Expr` given to a lazy parameter
+RRObj eval_expr(RRObj& expr, Env& env) {
+    return expr.data_expr->eval(env);
+}
+
+//release the tree at `root`; nodes are never shared, and `Expr` values only borrow them
+void delete_ast(ASTNode* root) {
+    for(int i = 0; i < root->children.size(); i++) delete_ast(root->children[i]);
+    delete root;
+}
+
+//name of a node in sampled stacks: its description and where it is
+string sample_frame_name(const void* frame) {
+    const ASTNode* node = (const ASTNode*) frame;
+    return node->describe() + " " + to_string(node->line) + ":" + to_string(node->col);
+}
+
 //a funny lil function
 ASTNode* apply_evaluate_with_args(ASTNode* root, ASTNode* args) {
+    if(root->type == ASTType::CSV) {
+        //only the last element is being called - `[1, f(2)]`
+        root->children.back() = apply_evaluate_with_args(root->children.back(), args);
+        return root;
+    }
     if(root->type != ASTType::OP || root->children.size() == 0) {
         return new ASTNode(ASTType::EVALUATE, {root, args});
     }
@@ -539,6 +796,11 @@ ASTNode* apply_evaluate_with_args(ASTNode* root, ASTNode* args) {
 
 //oh hey, another funny lil function
 ASTNode* apply_index(ASTNode* root, ASTNode* index) {
+    if(root->type == ASTType::CSV) {
+        //only the last element is being indexed - `[1, a[2]]`
+        root->children.back() = apply_index(root->children.back(), index);
+        return root;
+    }
     if(root->type != ASTType::OP) {
         return new ASTNode(ASTType::INDEX, {root, index});
     }
@@ -0,0 +1,194 @@
+// Pooled allocation of small blocks: values' payloads (strings, Lists, Vecs), argument vectors and the like
+// Small blocks are carved out of 64 KB slabs, each slab holding blocks of one size class. Freed blocks go on a
+// free list of their size class, one per thread, and the next allocation of that size takes the block back,
+// so evaluating the same code over and over stops calling malloc once the free lists have filled up.
+// The slabs are all in one reserved address range, so `delete` can tell pooled blocks from malloc'd ones.
+// When a thread exits, its free lists are handed over to the threads that are still running.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include <sys/mman.h>
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//blocks up to this size are pooled; bigger ones go to malloc
+const size_t POOL_MAX_BLOCK = 256;
+const size_t POOL_SLAB_BITS = 16;
+const size_t POOL_SLAB_BYTES = 1 << POOL_SLAB_BITS;
+//address space reserved for slabs; it's only backed by memory as slabs are handed out
+const size_t POOL_REGION_BYTES = 1ULL << 34;
+const int POOL_CLASSES = 12;
+
+//block size of each size class: steps of 16 bytes up to 128, then steps of 32
+const uint32_t POOL_CLASS_SIZE[POOL_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256};
+
+/*
+    Structs
+*/
+
+//a freed block, linked into the free list of its size class
+struct PoolBlock {
+    PoolBlock* next;
+};
+
+//the reserved address range, and the size class of every slab handed out from it
+struct PoolRegion {
+    char* base;
+    uint8_t* slab_class;
+    atomic<size_t> slabs_used;
+
+    PoolRegion() : base(nullptr), slab_class(nullptr), slabs_used(0) {
+//sanitizers only see blocks that come from malloc, so they get no pool
+#ifndef __SANITIZE_ADDRESS__
+        void* region = mmap(nullptr, POOL_REGION_BYTES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        void* classes = mmap(nullptr, POOL_REGION_BYTES >> POOL_SLAB_BITS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(region == MAP_FAILED || classes == MAP_FAILED) return; //everything goes to malloc instead
+        base = (char*) region;
+        slab_class = (uint8_t*) classes;
+#endif
+    }
+
+    bool contains(const void* ptr) const {
+        return base != nullptr && (uintptr_t) ptr - (uintptr_t) base < POOL_REGION_BYTES;
+    }
+
+    //a new slab for blocks of size class `cls`, or nullptr when the region is used up
+    char* new_slab(int cls) {
+        size_t slab = slabs_used.fetch_add(1, memory_order_relaxed);
+        if(slab >= POOL_REGION_BYTES >> POOL_SLAB_BITS) return nullptr;
+        char* start = base + slab * POOL_SLAB_BYTES;
+        if(mprotect(start, POOL_SLAB_BYTES, PROT_READ | PROT_WRITE) != 0) return nullptr;
+        slab_class[slab] = cls;
+        return start;
+    }
+
+    int class_of(const void* ptr) const {
+        return slab_class[((const char*) ptr - base) >> POOL_SLAB_BITS];
+    }
+};
+
+//the free lists of one thread, and the slab it's carving new blocks from, per size class
+struct PoolCache {
+    PoolBlock* free[POOL_CLASSES];
+    char* carve[POOL_CLASSES];
+    char* carve_end[POOL_CLASSES];
+};
+
+//free lists left by threads that have exited, for the other threads to take over
+struct PoolOrphans {
+    mutex lock;
+    PoolBlock* free[POOL_CLASSES];
+};
+
+//gives the free lists of its thread to the orphans when the thread exits
+struct PoolThreadExit {
+    ~PoolThreadExit();
+};
+
+thread_local PoolCache pool_cache; //zero-initialized, so usable before any constructor has run
+thread_local PoolThreadExit pool_thread_exit;
+
+/*
+    Functions
+*/
+
+//reserved on first use, since `new` may be called before globals are constructed
+PoolRegion& pool_region() {
+    static PoolRegion region;
+    return region;
+}
+
+PoolOrphans& pool_orphans() {
+    static PoolOrphans orphans;
+    return orphans;
+}
+
+//make sure this thread's free lists are given away when it exits
+void pool_register_thread() {
+    (void) &pool_thread_exit;
+}
+
+PoolThreadExit::~PoolThreadExit() {
+    PoolOrphans& orphans = pool_orphans();
+    lock_guard<mutex> guard(orphans.lock);
+    for(int cls = 0; cls < POOL_CLASSES; cls++) {
+        PoolBlock* block = pool_cache.free[cls];
+        while(block != nullptr) {
+            PoolBlock* next = block->next;
+            block->next = orphans.free[cls];
+            orphans.free[cls] = block;
+            block = next;
+        }
+        pool_cache.free[cls] = nullptr;
+    }
+}
+
+//take all of the orphaned blocks of size class `cls`
+PoolBlock* pool_adopt(int cls) {
+    PoolOrphans& orphans = pool_orphans();
+    lock_guard<mutex> guard(orphans.lock);
+    PoolBlock* blocks = orphans.free[cls];
+    orphans.free[cls] = nullptr;
+    return blocks;
+}
+
+int pool_class_of_size(size_t size) {
+    if(size <= 128) return size == 0 ? 0 : (size - 1) >> 4;
+    return 8 + ((size - 129) >> 5);
+}
+
+//a block of at least `size` bytes, or nullptr if it's not pooled
+void* pool_alloc(size_t size) {
+    if(size > POOL_MAX_BLOCK) return nullptr;
+    int cls = pool_class_of_size(size);
+    PoolCache& cache = pool_cache;
+    PoolBlock* block = cache.free[cls];
+    if(block != nullptr) {
+        cache.free[cls] = block->next;
+        return block;
+    }
+    uint32_t block_size = POOL_CLASS_SIZE[cls];
+    if(cache.carve[cls] == nullptr || cache.carve[cls] + block_size > cache.carve_end[cls]) {
+        pool_register_thread();
+        block = pool_adopt(cls);
+        if(block != nullptr) {
+            cache.free[cls] = block->next;
+            return block;
+        }
+        PoolRegion& region = pool_region();
+        if(region.base == nullptr) return nullptr;
+        char* slab = region.new_slab(cls);
+        if(slab == nullptr) return nullptr;
+        cache.carve[cls] = slab;
+        cache.carve_end[cls] = slab + POOL_SLAB_BYTES;
+    }
+    void* res = cache.carve[cls];
+    cache.carve[cls] += block_size;
+    return res;
+}
+
+bool pool_owns(const void* ptr) {
+    return pool_region().contains(ptr);
+}
+
+//size of pooled block `ptr`
+size_t pool_block_size(const void* ptr) {
+    return POOL_CLASS_SIZE[pool_region().class_of(ptr)];
+}
+
+//give pooled block `ptr` back to this thread's free list
+void pool_free(void* ptr) {
+    int cls = pool_region().class_of(ptr);
+    PoolBlock* block = (PoolBlock*) ptr;
+    if(pool_cache.free[cls] == nullptr) pool_register_thread(); //a thread may free blocks without ever allocating
+    block->next = pool_cache.free[cls];
+    pool_cache.free[cls] = block;
+}
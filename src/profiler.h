@@ -0,0 +1,109 @@
+// Profiling: how many times each AST node and builtin is evaluated, and how long it takes
+// Enabled by running with `--profile`; the report is printed to stderr when the program ends.
+// When disabled, the only cost is one check of `rr_profiling` per node evaluation and per builtin call.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//the report lists at most this many nodes
+const int PROFILE_REPORT_NODES = 25;
+
+bool rr_profiling = false;
+
+/*
+    Structs
+*/
+
+//evaluation count and wall time of one node or builtin
+//`self_ns` excludes the time of nodes evaluated inside it; builtins only have `total_ns`
+struct ProfileCounter {
+    unsigned long long count = 0;
+    long long total_ns = 0;
+    long long self_ns = 0;
+};
+
+//a line of the report: `where` in the source, and `what` ran there
+struct ProfileRow {
+    string where;
+    string what;
+    ProfileCounter counter;
+};
+
+//time spent so far in nodes nested inside the node currently timed
+long long prof_nested_ns = 0;
+
+long long prof_now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//times one evaluation of a node, from construction until destruction
+struct NodeTimer {
+    ProfileCounter& counter;
+    long long start;
+    long long outer_nested;
+
+    NodeTimer(ProfileCounter& counter) : counter(counter), start(prof_now_ns()), outer_nested(prof_nested_ns) {
+        prof_nested_ns = 0;
+    }
+    ~NodeTimer() {
+        long long elapsed = prof_now_ns() - start;
+        counter.count++;
+        counter.total_ns += elapsed;
+        counter.self_ns += elapsed - prof_nested_ns;
+        //to the enclosing node, all of this node is nested time
+        prof_nested_ns = outer_nested + elapsed;
+    }
+};
+
+//times one builtin call; the calling node still counts it as its own time
+struct CallTimer {
+    ProfileCounter& counter;
+    long long start;
+
+    CallTimer(ProfileCounter& counter) : counter(counter), start(prof_now_ns()) {}
+    ~CallTimer() {
+        counter.count++;
+        counter.total_ns += prof_now_ns() - start;
+    }
+};
+
+/*
+    Functions
+*/
+
+void print_profile_row(const ProfileRow& row, bool is_node) {
+    if(is_node) fprintf(stderr, "%12.3f", row.counter.self_ns / 1e6);
+    fprintf(stderr, "%12.3f %12llu  ", row.counter.total_ns / 1e6, row.counter.count);
+    if(is_node) fprintf(stderr, "%-9s ", row.where.c_str());
+    fprintf(stderr, "%s\n", row.what.c_str());
+}
+
+//print the nodes with the most self time, and all the builtins that were called, by total time
+void print_profile_report(vector<ProfileRow>& nodes, vector<ProfileRow>& builtins, long long program_ns) {
+    sort(nodes.begin(), nodes.end(), [](const ProfileRow& a, const ProfileRow& b) {
+        return a.counter.self_ns > b.counter.self_ns;
+    });
+    sort(builtins.begin(), builtins.end(), [](const ProfileRow& a, const ProfileRow& b) {
+        return a.counter.total_ns > b.counter.total_ns;
+    });
+    fprintf(stderr, "--profile: %.3f ms total\n\n", program_ns / 1e6);
+    fprintf(stderr, "hot spots, by self time:\n");
+    fprintf(stderr, "%12s%12s %12s  %-9s %s\n", "self ms", "total ms", "count", "line:col", "node");
+    for(int i = 0; i < nodes.size() && i < PROFILE_REPORT_NODES; i++) print_profile_row(nodes[i], true);
+    if(nodes.size() > PROFILE_REPORT_NODES) fprintf(stderr, "  (%d more nodes)\n", (int) nodes.size() - PROFILE_REPORT_NODES);
+    fprintf(stderr, "\nbuiltins, by total time:\n");
+    fprintf(stderr, "%12s %12s  %s\n", "total ms", "count", "builtin");
+    for(int i = 0; i < builtins.size(); i++) print_profile_row(builtins[i], false);
+    fflush(stderr);
+}
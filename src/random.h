@@ -0,0 +1,249 @@
+// Random numbers: uniform, normal, binomial and Poisson samples, and random permutations
+// Numbers come from the Philox4x32-10 counter-based generator: a random block is a pure function of the seed
+// and a counter, with no state carried from one number to the next. Sample `i` of the `call`-th random call
+// uses counters (i, draw, call) only, so a Vec can be filled by any number of threads in any order and still
+// come out the same for the same seed.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//random Vecs with fewer elements than this are filled on a single thread
+const size_t RANDOM_MIN_PARALLEL = 1 << 20;
+
+const uint32_t PHILOX_M0 = 0xD2511F53;
+const uint32_t PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+
+/*
+    Structs
+*/
+
+//four random 32 bit words for one counter
+struct PhiloxBlock {
+    uint32_t words[4];
+
+    uint64_t u64(int half) const {
+        return ((uint64_t) words[half * 2] << 32) | words[half * 2 + 1];
+    }
+};
+
+//a seeded random stream; `call` numbers the random calls made, so each one gets fresh counters
+struct RRRandom {
+    uint32_t key[2];
+    uint32_t call;
+
+    RRRandom() {
+        seed(0, 0);
+    }
+
+    //streams with different `stream` numbers are independent, even for the same `seed`
+    void seed(uint64_t seed, uint64_t stream) {
+        uint64_t k = mix(seed ^ mix(stream + PHILOX_W0));
+        key[0] = (uint32_t) k;
+        key[1] = (uint32_t) (k >> 32);
+        call = 0;
+    }
+
+    //the random block for draw `draw` of sample `i` in call `call_id`
+    PhiloxBlock block(uint64_t i, uint32_t draw, uint32_t call_id) const {
+        uint32_t ctr[4] = {(uint32_t) i, (uint32_t) (i >> 32), draw, call_id};
+        uint32_t k0 = key[0], k1 = key[1];
+        for(int round = 0; round < 10; round++) {
+            uint64_t p0 = (uint64_t) PHILOX_M0 * ctr[0];
+            uint64_t p1 = (uint64_t) PHILOX_M1 * ctr[2];
+            uint32_t next[4] = {(uint32_t) (p1 >> 32) ^ ctr[1] ^ k0, (uint32_t) p1, (uint32_t) (p0 >> 32) ^ ctr[3] ^ k1, (uint32_t) p0};
+            for(int w = 0; w < 4; w++) ctr[w] = next[w];
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        PhiloxBlock res;
+        for(int w = 0; w < 4; w++) res.words[w] = ctr[w];
+        return res;
+    }
+
+    static uint64_t mix(uint64_t num) {
+        num ^= num >> 30;
+        num *= 0xbf58476d1ce4e5b9ULL;
+        num ^= num >> 27;
+        num *= 0x94d049bb133111ebULL;
+        return num ^ (num >> 31);
+    }
+};
+
+//the random stream used by the interpreter; seeded with `set_seed`
+//each thread running programs has its own; helper threads of a builtin are given their caller's
+thread_local RRRandom rr_random;
+
+/*
+    Functions
+*/
+
+//uniform in [0, 1)
+double unit_float(uint64_t bits) {
+    return (bits >> 11) * 0x1.0p-53;
+}
+//uniform in (0, 1]
+double unit_float_nonzero(uint64_t bits) {
+    return ((bits >> 11) + 1) * 0x1.0p-53;
+}
+
+//uniform in [0, n), by multiplying instead of dividing (bias is at most n / 2^64)
+uint64_t bounded(uint64_t bits, uint64_t n) {
+    return (uint64_t) (((unsigned __int128) bits * n) >> 64);
+}
+
+//the random numbers of sample `i`, two 64 bit numbers per block
+struct SampleDraws {
+    const RRRandom& random;
+    uint64_t i;
+    uint32_t call;
+    uint32_t at;
+    PhiloxBlock current;
+
+    SampleDraws(const RRRandom& random, uint64_t i, uint32_t call) : random(random), i(i), call(call), at(0) {}
+
+    uint64_t next() {
+        if(at % 2 == 0) current = random.block(i, at / 2, call);
+        return current.u64(at++ % 2);
+    }
+    double uniform() {
+        return unit_float(next());
+    }
+};
+
+//out[i] = sample(draws of sample i) for every i, on several threads for big outputs
+//`sample` is called as sample(SampleDraws&)
+template<typename T, typename Sample>
+void fill_random(vector<T>& out, size_t n, Sample sample) {
+    out.resize(n);
+    RRRandom& random = rr_random;
+    uint32_t call = random.call++;
+    auto fill_range = [&](size_t from, size_t to) {
+        for(size_t i = from; i < to; i++) {
+            SampleDraws draws(random, i, call);
+            out[i] = sample(draws);
+        }
+    };
+    size_t nthreads = min((size_t) thread::hardware_concurrency(), n / RANDOM_MIN_PARALLEL);
+    if(nthreads <= 1) {
+        fill_range(0, n);
+        return;
+    }
+    vector<thread> workers;
+    for(size_t t = 0; t < nthreads; t++) workers.push_back(thread(fill_range, n * t / nthreads, n * (t + 1) / nthreads));
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+//standard normal, by Box-Muller
+double sample_normal(SampleDraws& draws) {
+    double u = unit_float_nonzero(draws.next());
+    double v = unit_float(draws.next());
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+//Poisson with mean `lambda`
+//small means count exponential gaps (Knuth); big ones use transformed rejection (Hörmann's PTRS)
+long long sample_poisson(SampleDraws& draws, double lambda) {
+    if(lambda < 10) {
+        double limit = exp(-lambda);
+        double prod = draws.uniform();
+        long long k = 0;
+        while(prod > limit) {
+            prod *= draws.uniform();
+            k++;
+        }
+        return k;
+    }
+    double slam = sqrt(lambda);
+    double loglam = log(lambda);
+    double b = 0.931 + 2.53 * slam;
+    double a = -0.059 + 0.02483 * b;
+    double inv_alpha = 1.1239 + 1.1328 / (b - 3.4);
+    double v_r = 0.9277 - 3.6224 / (b - 2);
+    while(true) {
+        double u = draws.uniform() - 0.5;
+        double v = draws.uniform();
+        double us = 0.5 - fabs(u);
+        long long k = (long long) floor((2 * a / us + b) * u + lambda + 0.43);
+        if(us >= 0.07 && v <= v_r) return k;
+        if(k < 0 || (us < 0.013 && v > us)) continue;
+        if(log(v) + log(inv_alpha) - log(a / (us * us) + b) <= -lambda + k * loglam - lgamma(k + 1.0)) return k;
+    }
+}
+
+//log of the binomial probability of `k` successes out of `n`, up to a constant
+double binomial_log_weight(long long n, long long k, double log_p, double log_q) {
+    return -lgamma(k + 1.0) - lgamma(n - k + 1.0) + k * log_p + (n - k) * log_q;
+}
+
+//binomial: successes out of `n` tries with probability `p` (at most 0.5)
+//a small mean walks the probabilities from 0 (inversion); a big one uses transformed rejection (Hörmann's BTRS)
+long long sample_binomial_low(SampleDraws& draws, long long n, double p) {
+    double q = 1 - p;
+    if(n * p < 10) {
+        double s = p / q;
+        double a = (n + 1) * s;
+        double r = pow(q, (double) n);
+        double u = draws.uniform();
+        long long k = 0;
+        while(u > r && k < n) {
+            u -= r;
+            k++;
+            r *= a / k - s;
+        }
+        return k;
+    }
+    double spq = sqrt(n * p * q);
+    double b = 1.15 + 2.53 * spq;
+    double a = -0.0873 + 0.0248 * b + 0.01 * p;
+    double c = n * p + 0.5;
+    double v_r = 0.92 - 4.2 / b;
+    double alpha = (2.83 + 5.1 / b) * spq;
+    double log_p = log(p), log_q = log(q);
+    long long mode = (long long) floor((n + 1) * p);
+    double mode_weight = binomial_log_weight(n, mode, log_p, log_q);
+    while(true) {
+        double u = draws.uniform() - 0.5;
+        double v = draws.uniform();
+        double us = 0.5 - fabs(u);
+        long long k = (long long) floor((2 * a / us + b) * u + c);
+        if(k < 0 || k > n) continue;
+        if(us >= 0.07 && v <= v_r) return k;
+        v = log(v * alpha / (a / (us * us) + b));
+        if(v <= binomial_log_weight(n, k, log_p, log_q) - mode_weight) return k;
+    }
+}
+
+long long sample_binomial(SampleDraws& draws, long long n, double p) {
+    if(p <= 0.5) return sample_binomial_low(draws, n, p);
+    return n - sample_binomial_low(draws, n, 1 - p);
+}
+
+//the first `k` positions of a random permutation of [0, n), by a partial Fisher-Yates shuffle
+vector<size_t> random_positions(size_t n, size_t k) {
+    if(k > n) rr_runtime_error("Cannot take "s + to_string(k) + " samples out of " + to_string(n) + " without replacement");
+    vector<size_t> idx(n);
+    for(size_t i = 0; i < n; i++) idx[i] = i;
+    uint32_t call = rr_random.call++;
+    for(size_t i = 0; i < k; i++) {
+        SampleDraws draws(rr_random, i, call);
+        swap(idx[i], idx[i + bounded(draws.next(), n - i)]);
+    }
+    idx.resize(k);
+    return idx;
+}
@@ -0,0 +1,156 @@
+// Interactive mode: a prompt that evaluates statements as soon as they're entered, keeping variables between them
+// Run with `--repl`. Each line is tokenized as it comes in; the lines read so far are parsed and evaluated once
+// their brackets and strings are closed, so a `{}` block can span lines. The values of statements other than
+// assignments and `print` calls are printed, and stderr gets how long each statement took.
+// Prompts are only shown when stdin is a terminal.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "environment.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Structs
+*/
+
+//lines entered since the last evaluation
+struct ReplChunk {
+    vector<Token> tokens;
+    string pending; //lines inside a string that isn't closed yet; they're tokenized once it is
+    int pending_line = 0; //where `pending` starts
+    int depth = 0; //brackets opened and not closed
+
+    void clear() {
+        tokens.clear();
+        pending.clear();
+        depth = 0;
+    }
+    bool empty() {
+        return tokens.empty() && pending.empty();
+    }
+};
+
+/*
+    Functions
+*/
+
+//whether `text` ends inside a string literal; strings are read the way the tokenizer reads them
+bool ends_in_string(const string& text) {
+    bool in_string = false;
+    for(size_t i = 0; i < text.size(); i++) {
+        if(in_string) {
+            if(text[i] == '"') in_string = false;
+        } else if(text[i] == '"' || text[i] == '\'') {
+            in_string = true;
+        } else if(text[i] == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            while(i < text.size() && text[i] != '\n') i++;
+        }
+    }
+    return in_string;
+}
+
+//add `line` (read as line `line_no` of the session) to `chunk`; true once the chunk can be parsed
+bool repl_add_line(ReplChunk& chunk, const string& line, int line_no) {
+    if(chunk.pending.empty()) chunk.pending_line = line_no;
+    chunk.pending += line;
+    chunk.pending += '\n';
+    if(ends_in_string(chunk.pending)) return false;
+
+    Tokenizer tokenizer = Tokenizer::from_source(chunk.pending);
+    vector<Token> tokens = tokenizer.tokenize();
+    tokens.pop_back(); //T_NONE; the chunk gets one when it's parsed
+    for(int i = 0; i < tokens.size(); i++) {
+        tokens[i].line += chunk.pending_line - 1;
+        if(tokens[i].type == TokenType::T_DELIM) {
+            const string& t = tokens[i].t;
+            if(t == "(" || t == "[" || t == "{") chunk.depth++;
+            else if(t == ")" || t == "]" || t == "}") chunk.depth--;
+        }
+        chunk.tokens.push_back(tokens[i]);
+    }
+    chunk.pending.clear();
+    return chunk.depth <= 0;
+}
+
+//whether the value of `statement` is shown already, or needn't be
+bool repl_quiet(ASTNode* statement) {
+    if(statement->type == ASTType::OP) return statement->symbol == "=" && statement->children.size() == 2;
+    return statement->type == ASTType::EVALUATE && statement->children[0]->type == ASTType::FUN
+        && statement->children[0]->symbol == "print";
+}
+
+//evaluate the statements of `root` one by one, printing their values and how long each took
+void repl_eval(ASTNode* root, Env& env) {
+    for(int i = 0; i < root->children.size(); i++) {
+        ASTNode* statement = root->children[i];
+        auto start = chrono::steady_clock::now();
+        try {
+            release_replaced();
+            RRObj value = statement->eval(env);
+            if(!repl_quiet(statement) && !(value.type == RRDataType("None"))) rr_out << value << '\n';
+        } catch(RRError& error) {
+            rr_out << "--RR: Runtime error: " << error.what() << '\n';
+            rr_out.flush();
+            return; //the rest of what was entered depends on this statement
+        } catch(bad_alloc&) {
+            rr_out << "--RR: Runtime error: Out of memory\n";
+            rr_out.flush();
+            return;
+        } catch(exception& error) {
+            rr_out << "--RR: Runtime error: " << error.what() << '\n';
+            rr_out.flush();
+            return;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        rr_out.flush();
+        fprintf(stderr, "--repl: line %d took %.3f ms\n", statement->line, ms);
+    }
+}
+
+//read statements from stdin and evaluate them until it ends
+int run_repl() {
+    init_datatypes();
+    Env env = Env();
+    Env::init_with_default(env);
+    bool prompt = isatty(STDIN_FILENO);
+    ReplChunk chunk;
+    string line;
+    int line_no = 0;
+    while(true) {
+        if(prompt) {
+            rr_out << (chunk.empty() ? "rr> " : "... ");
+            rr_out.flush();
+        }
+        if(!getline(cin, line)) break;
+        line_no++;
+        if(!repl_add_line(chunk, line, line_no)) continue;
+        chunk.tokens.push_back(Token { "", TokenType::T_NONE });
+        ASTNode* root = nullptr;
+        try {
+            MemCategory category(MEM_AST);
+            root = Parser::from_tokens(chunk.tokens).parse(env);
+        } catch(exception& error) {
+            rr_out << "--RR: Error while parsing: " << error.what() << '\n';
+            rr_out.flush();
+        }
+        chunk.clear();
+        if(root == nullptr) continue;
+        repl_eval(root, env);
+        delete_ast(root);
+    }
+    if(!chunk.empty()) rr_out << "--RR: Error while parsing: Reached end of input inside a statement\n";
+    if(prompt) rr_out << '\n';
+    rr_out.flush();
+    return 0;
+}
@@ -0,0 +1,311 @@
+// Saving objects to, and loading them from, RR's binary data format
+/*
+    File layout (native byte order, every field aligned to 8 bytes):
+    - header: magic "RRDATA\0\0", u32 version, u32 byte order check (0x01020304)
+    - one object record:
+      - u64 tag (BinTag), then
+      - Bool/Int/Float: 8 byte value
+      - Str: u64 length, bytes
+      - List: u64 count, `count` records
+      - Vec: u64 element tag, u64 length, u64 size of data in bytes, data
+        - Int/Bool/Float data: `length` 8 byte values, usable in place once the file is mapped
+        - Str data: `length`+1 u64 offsets into the bytes that follow them
+      - DataFrame: u64 column count, then for every column its name (as a Str, without a tag) and a Vec record
+      - None: nothing
+      - Matrix: u64 rows, u64 cols, rows*cols 8 byte Floats, row by row
+    Strings are padded with zeros up to the next multiple of 8 bytes.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include "datatypes.h"
+#include "rr_obj.h"
+#include "rr_vec.h"
+#include "rr_matrix.h"
+#include "mapped_file.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+const char BIN_MAGIC[8] = {'R', 'R', 'D', 'A', 'T', 'A', 0, 0};
+const uint32_t BIN_VERSION = 1;
+const uint32_t BIN_BYTE_ORDER = 0x01020304;
+
+//object kinds in a file; never reorder, only append (files depend on the numbers)
+enum BinTag {
+    BIN_NONE,
+    BIN_BOOL,
+    BIN_INT,
+    BIN_FLOAT,
+    BIN_STR,
+    BIN_LIST,
+    BIN_VEC,
+    BIN_DATAFRAME,
+    BIN_MATRIX
+};
+
+/*
+    Structs
+*/
+
+struct BinWriter {
+    FILE* file;
+    string path;
+
+    void bytes(const void* data, size_t n) {
+        if(n != 0 && fwrite(data, 1, n, file) != n) rr_runtime_error("Couldn't write to file '"s + path + "'");
+    }
+    void u64(uint64_t num) {
+        bytes(&num, 8);
+    }
+    //zeros up to the next multiple of 8, after `n` bytes of data
+    void pad(size_t n) {
+        static const char zeros[8] = {0};
+        bytes(zeros, (8 - n % 8) % 8);
+    }
+    void str(const string& s) {
+        u64(s.size());
+        bytes(s.data(), s.size());
+        pad(s.size());
+    }
+
+    void vec(RRVec& vec) {
+        size_t len = vec.size();
+        if(vec.holds_strs()) {
+            u64(BIN_STR);
+            u64(len);
+            size_t text_size = 0;
+            for(size_t i = 0; i < len; i++) text_size += vec.strs[i].size();
+            u64((len + 1) * 8 + text_size + (8 - text_size % 8) % 8);
+            uint64_t offset = 0;
+            for(size_t i = 0; i < len; i++) {
+                u64(offset);
+                offset += vec.strs[i].size();
+            }
+            u64(offset);
+            for(size_t i = 0; i < len; i++) bytes(vec.strs[i].data(), vec.strs[i].size());
+            pad(text_size);
+        } else if(vec.holds_floats()) {
+            u64(BIN_FLOAT);
+            u64(len);
+            u64(len * 8);
+            bytes(vec.float_data(), len * 8);
+        } else {
+            u64(vec.elem == RRDataType("Bool") ? BIN_BOOL : BIN_INT);
+            u64(len);
+            u64(len * 8);
+            bytes(vec.int_data(), len * 8);
+        }
+    }
+
+    void obj(const RRObj& obj) {
+        if(obj.type == RRDataType("None")) {
+            u64(BIN_NONE);
+        } else if(obj.type == RRDataType("Bool")) {
+            u64(BIN_BOOL);
+            u64(obj.data_bool);
+        } else if(obj.type == RRDataType("Int")) {
+            u64(BIN_INT);
+            bytes(&obj.data_int, 8);
+        } else if(obj.type == RRDataType("Float")) {
+            u64(BIN_FLOAT);
+            bytes(&obj.data_float, 8);
+        } else if(obj.type == RRDataType("Str")) {
+            u64(BIN_STR);
+            str(*obj.data_str);
+        } else if(obj.type == RRDataType("List")) {
+            u64(BIN_LIST);
+            u64(obj.data_list->size());
+            for(int i = 0; i < obj.data_list->size(); i++) this->obj((*obj.data_list)[i]);
+        } else if(obj.type == RRDataType("ListView")) {
+            //a view is saved as the List it stands for
+            u64(BIN_LIST);
+            u64(obj.data_view->len);
+            for(long long i = 0; i < obj.data_view->len; i++) this->obj(obj.data_view->at(i));
+        } else if(obj.type == RRDataType("Vec")) {
+            u64(BIN_VEC);
+            vec(*obj.data_vec);
+        } else if(obj.type == RRDataType("DataFrame")) {
+            RRDataFrame* frame = obj.data_frame;
+            u64(BIN_DATAFRAME);
+            u64(frame->columns.size());
+            for(int i = 0; i < frame->columns.size(); i++) {
+                if(frame->columns[i] == nullptr) rr_runtime_error("Cannot save a DataFrame that has given away a column");
+                str(frame->names[i]);
+                vec(*frame->columns[i]);
+            }
+        } else if(obj.type == RRDataType("Matrix")) {
+            u64(BIN_MATRIX);
+            u64(obj.data_matrix->rows);
+            u64(obj.data_matrix->cols);
+            bytes(obj.data_matrix->data.data(), obj.data_matrix->data.size() * 8);
+        } else {
+            rr_runtime_error("Cannot save an object of type "s + single_type_of(obj.type.type));
+        }
+    }
+};
+
+//reads records out of a mapped file; numeric Vec data is not copied or even touched,
+// so the pages of columns that are never used are never read from disk
+struct BinReader {
+    shared_ptr<MappedFile> file;
+    size_t pos;
+
+    const char* take(size_t n) {
+        if(n > file->size - pos) rr_runtime_error("Data file is truncated or corrupt");
+        const char* at = file->data + pos;
+        pos += n;
+        return at;
+    }
+    uint64_t u64() {
+        uint64_t num;
+        memcpy(&num, take(8), 8);
+        return num;
+    }
+    string str() {
+        size_t len = u64();
+        string s(take(len), len);
+        take((8 - len % 8) % 8);
+        return s;
+    }
+
+    RRVec* vec() {
+        uint64_t elem_tag = u64();
+        size_t len = u64();
+        size_t data_size = u64();
+        const char* data = take(data_size);
+        RRVec* vec;
+        switch(elem_tag) {
+            case BIN_BOOL:
+            case BIN_INT: {
+                if(len != data_size / 8 || data_size % 8 != 0) rr_runtime_error("Data file is corrupt");
+                vec = new RRVec(RRDataType(elem_tag == BIN_BOOL ? "Bool" : "Int"));
+                vec->mapped_ints = (const long long*) data;
+            }; break;
+            case BIN_FLOAT: {
+                if(len != data_size / 8 || data_size % 8 != 0) rr_runtime_error("Data file is corrupt");
+                vec = new RRVec(RRDataType("Float"));
+                vec->mapped_floats = (const double*) data;
+            }; break;
+            case BIN_STR: {
+                //compared before multiplying, so a huge `len` can't wrap around
+                if(len >= data_size / 8) rr_runtime_error("Data file is corrupt");
+                vec = new RRVec(RRDataType("Str"));
+                const char* text = data + (len + 1) * 8;
+                size_t text_size = data_size - (len + 1) * 8;
+                vec->strs.reserve(len);
+                for(size_t i = 0; i < len; i++) {
+                    uint64_t from, to;
+                    memcpy(&from, data + i * 8, 8);
+                    memcpy(&to, data + (i + 1) * 8, 8);
+                    if(from > to || to > text_size) rr_runtime_error("Data file is corrupt");
+                    vec->strs.push_back(string(text + from, to - from));
+                }
+                return vec;
+            };
+            default: rr_runtime_error("Data file has a Vec of unknown type");
+        }
+        vec->mapped = file;
+        vec->mapped_len = len;
+        return vec;
+    }
+
+    RRObj obj() {
+        uint64_t tag = u64();
+        switch(tag) {
+            case BIN_NONE: return RRObj();
+            case BIN_BOOL: {
+                RRObj res = RRObj(RRDataType("Bool"));
+                res.data_bool = u64() != 0;
+                return res;
+            };
+            case BIN_INT: {
+                RRObj res = RRObj(RRDataType("Int"));
+                memcpy(&res.data_int, take(8), 8);
+                return res;
+            };
+            case BIN_FLOAT: {
+                RRObj res = RRObj(RRDataType("Float"));
+                memcpy(&res.data_float, take(8), 8);
+                return res;
+            };
+            case BIN_STR: {
+                string s = str();
+                return RRObj(s);
+            };
+            case BIN_LIST: {
+                size_t count = u64();
+                RRObj list = RRObj(new vector<RRObj>());
+                for(size_t i = 0; i < count; i++) list.data_list->push_back(obj());
+                return list;
+            };
+            case BIN_VEC: {
+                RRObj res = RRObj(RRDataType("Vec"));
+                res.data_vec = vec();
+                return res;
+            };
+            case BIN_DATAFRAME: {
+                size_t ncols = u64();
+                RRObj res = RRObj(RRDataType("DataFrame"));
+                res.data_frame = new RRDataFrame();
+                for(size_t i = 0; i < ncols; i++) {
+                    res.data_frame->names.push_back(str());
+                    res.data_frame->columns.push_back(vec());
+                }
+                return res;
+            };
+            case BIN_MATRIX: {
+                size_t rows = u64();
+                size_t cols = u64();
+                if(cols != 0 && rows > (file->size - pos) / 8 / cols) rr_runtime_error("Data file is truncated or corrupt");
+                RRObj res = RRObj(RRDataType("Matrix"));
+                res.data_matrix = new RRMatrix(rows, cols);
+                memcpy(res.data_matrix->data.data(), take(rows * cols * 8), rows * cols * 8);
+                return res;
+            };
+        }
+        rr_runtime_error("Data file has an object of unknown type");
+        exit(1);
+    }
+};
+
+/*
+    Functions
+*/
+
+void save_obj(const RRObj& obj, const string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if(file == nullptr) rr_runtime_error("Couldn't open file '"s + path + "' for writing");
+    BinWriter writer = { file, path };
+    try {
+        writer.bytes(BIN_MAGIC, 8);
+        uint32_t header[2] = {BIN_VERSION, BIN_BYTE_ORDER};
+        writer.bytes(header, 8);
+        writer.obj(obj);
+    } catch(RRError&) {
+        fclose(file); //the error goes on to the caller, which may keep running
+        throw;
+    }
+    if(fclose(file) != 0) rr_runtime_error("Couldn't write to file '"s + path + "'");
+}
+
+RRObj load_obj(const string& path) {
+    BinReader reader = { make_shared<MappedFile>(path), 0 };
+    if(memcmp(reader.take(8), BIN_MAGIC, 8) != 0) rr_runtime_error("'"s + path + "' is not an RR data file");
+    uint32_t header[2];
+    memcpy(header, reader.take(8), 8);
+    if(header[1] != BIN_BYTE_ORDER) rr_runtime_error("'"s + path + "' was saved on a machine with a different byte order");
+    if(header[0] != BIN_VERSION) rr_runtime_error("'"s + path + "' has unsupported version "s + to_string(header[0]));
+    return reader.obj();
+}
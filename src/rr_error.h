@@ -2,19 +2,34 @@
 
 #include <string>
 #include <iostream>
+#include <stdexcept>
+
+#include "rr_output.h"
 
 using namespace std;
 
-void rr_runtime_error(string error_message) {
-    cout << "--RR: Runtime error: " << error_message << endl << "Aborting" << endl;
-    exit(1);
+//an error in an RR program; it unwinds to whoever is running the program:
+// the interpreter prints it and exits, an embedding host gets it back as a failed result (see librr.h)
+struct RRError : runtime_error {
+    bool parsing; //found while parsing, rather than while evaluating
+
+    RRError(bool parsing, const string& message) : runtime_error(message), parsing(parsing) {}
+};
+
+[[noreturn]] void rr_runtime_error(string error_message) {
+    throw RRError(false, error_message);
 }
 
-void parse_error(string error_message) {
-    cout << "--RR: Error while parsing: " << error_message << endl << "Aborting" << endl;
-    exit(1);
+[[noreturn]] void parse_error(string error_message) {
+    throw RRError(true, error_message);
+}
+
+//print `error` the way the interpreter reports errors
+void report_error(const RRError& error) {
+    rr_out << "--RR: " << (error.parsing ? "Error while parsing: " : "Runtime error: ") << error.what() << "\nAborting\n";
+    rr_out.flush();
 }
 
 void warning(string warning_message) {
-    cout << "--RR: Warning: " << warning_message << endl;
-}
\ No newline at end of file
+    rr_out << "--RR: Warning: " << warning_message << '\n';
+}
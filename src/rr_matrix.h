@@ -0,0 +1,37 @@
+// Dense Matrix of Floats
+
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+/*
+    Structs
+*/
+
+//a `rows` x `cols` matrix of Floats, stored row by row in one contiguous array
+struct RRMatrix {
+    size_t rows;
+    size_t cols;
+    vector<double> data;
+
+    RRMatrix(size_t rows, size_t cols) {
+        this->rows = rows;
+        this->cols = cols;
+        this->data.assign(rows * cols, 0);
+    }
+
+    double& at(size_t row, size_t col) {
+        return data[row * cols + col];
+    }
+    double at(size_t row, size_t col) const {
+        return data[row * cols + col];
+    }
+    double* row(size_t row) {
+        return data.data() + row * cols;
+    }
+    const double* row(size_t row) const {
+        return data.data() + row * cols;
+    }
+};
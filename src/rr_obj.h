@@ -5,19 +5,68 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <cstring>
+#include <charconv>
 
 #include "datatypes.h"
+#include "rr_vec.h"
+#include "rr_matrix.h"
 #include "tokenizer.h"
 #include "rr_error.h"
+#include "rr_output.h"
+#include "profiler.h"
+#include "mem_stats.h"
 
 using namespace std;
 
 struct RRFun;
+struct Env;
 struct RRObj;
+struct ASTNode;
+
+//the number written in literal `text`; one that doesn't fit in a `T` is a parse error
+template<typename T>
+T number_literal(const string& text, const char* type_name) {
+    T value = 0;
+    auto res = from_chars(text.data(), text.data() + text.size(), value);
+    if(res.ec == errc::result_out_of_range) parse_error(string(type_name) + " literal out of range: " + text);
+    if(res.ec != errc()) parse_error(string("Invalid ") + type_name + " literal: " + text);
+    return value;
+}
+
+//`start:stop:step`, made by the `:` operator
+struct RRSlice {
+    long long start;
+    long long stop;
+    long long step;
+};
+
+//a window into a List that shares the List's elements instead of copying them
+//either a slice (`start`, `step`, `len`) or a gather of the elements at `indices`
+//views are never stored: storing one (`to_owned`) or copying it gives a real List instead
+struct RRListView {
+    vector<RRObj>* parent;
+    bool owns_parent; //when indexing into a temporary, the view keeps it alive
+    vector<RRObj>* indices; //nullptr for slices
+    bool owns_indices;
+    long long start;
+    long long step;
+    long long len;
+
+    ~RRListView();
+    //index into `parent` of the `i`th element of the view
+    long long parent_index(long long i);
+    //get `i`th element of the view
+    RRObj& at(long long i);
+    //copy the elements of the view into a new vector
+    vector<RRObj>* to_list();
+};
 
 //takes ownership of the data whenever `owner = true`
+//`owner` sits next to the 4 byte type, in what would otherwise be padding before the 8 byte data,
+// so a value is 16 bytes: a List element fits in two words and four elements share a cache line
 struct RRObj {
     RRDataType type;
+    bool owner;
     union {
         long long data_int;
         double data_float;
@@ -28,26 +77,44 @@ struct RRObj {
         unordered_set<RRObj>* data_set;
         unordered_map<RRObj, RRObj>* data_map;
         pair<RRObj, RRObj>* data_pair;
+        ASTNode* data_expr;
+        RRSlice* data_slice;
+        RRListView* data_view;
+        RRVec* data_vec;
+        RRDataFrame* data_frame;
+        RRMatrix* data_matrix;
     };
-    bool owner;
 
     RRObj() {
         type = RRDataType();
         data_int = 0;
         owner = true;
     }
-    //deep clone constructor
+    //deep clone constructor; copying a reference gives another reference
     RRObj(const RRObj& from) {
-        type = from.type;
-        if(type == RRDataType("Str")) {
-            data_str = new string(*from.data_str);
-        } else if(type == RRDataType("List")) {
-            data_list = new vector<RRObj>(*from.data_list);
-        } else {
-            memcpy(this, &from, sizeof(RRObj));
+        memcpy(this, &from, sizeof(RRObj));
+        if(!from.owner) return;
+        switch(type.type) {
+            case DATATYPE_STR:
+            case DATATYPE_STR_BUILDER: data_str = new string(*from.data_str); break;
+            case DATATYPE_LIST: data_list = new vector<RRObj>(*from.data_list); break;
+            case DATATYPE_SLICE: data_slice = new RRSlice(*from.data_slice); break;
+            case DATATYPE_LIST_VIEW: {
+                type = RRDataType("List");
+                data_list = from.data_view->to_list();
+            }; break;
+            case DATATYPE_VEC: data_vec = new RRVec(*from.data_vec); break;
+            case DATATYPE_DATA_FRAME: data_frame = new RRDataFrame(*from.data_frame); break;
+            case DATATYPE_MATRIX: data_matrix = new RRMatrix(*from.data_matrix); break;
+            default: break; //stored in place, or never owned
         }
-        owner = true;
     }
+    //move constructor; `from` is left as a reference, so the data is released only once
+    RRObj(RRObj&& from) noexcept {
+        memcpy(this, &from, sizeof(RRObj));
+        from.owner = false;
+    }
+    RRObj& operator=(const RRObj& other) = default;
     RRObj(RRDataType t) {
         type = t;
         data_int = 0;
@@ -58,8 +125,8 @@ struct RRObj {
         switch(t.info) {
             case TokenInfo::L_BOOL: this->data_bool = (t.t == "true" ? 1 : 0); break;
             case TokenInfo::L_STR: this->data_str = (new string(t.t)); break;
-            case TokenInfo::L_INT: this->data_int = (stol(t.t)); break;
-            case TokenInfo::L_FLOAT: this->data_float = (stod(t.t)); break;
+            case TokenInfo::L_INT: this->data_int = number_literal<long long>(t.t, "Int"); break;
+            case TokenInfo::L_FLOAT: this->data_float = number_literal<double>(t.t, "Float"); break;
             default: break;
         }
         owner = true;
@@ -81,12 +148,17 @@ struct RRObj {
     }
 
     ~RRObj() {
-        if(owner) {
-            if(type == RRDataType("Str")) {
-                delete data_str;
-            } else if(type == RRDataType("List")) {
-                delete data_list;
-            }
+        if(!owner) return;
+        switch(type.type) {
+            case DATATYPE_STR:
+            case DATATYPE_STR_BUILDER: delete data_str; break;
+            case DATATYPE_LIST: delete data_list; break;
+            case DATATYPE_SLICE: delete data_slice; break;
+            case DATATYPE_LIST_VIEW: delete data_view; break;
+            case DATATYPE_VEC: delete data_vec; break;
+            case DATATYPE_DATA_FRAME: delete data_frame; break;
+            case DATATYPE_MATRIX: delete data_matrix; break;
+            default: break;
         }
     }
 
@@ -102,14 +174,16 @@ struct RRObj {
 
     //make a reference to `this` - reference will not release the resources
     RRObj ref() {
-        RRObj reference = *this;
+        RRObj reference;
+        memcpy(&reference, this, sizeof(RRObj));
         reference.owner = false;
         return reference;
     }
     //move ownership of data from `this` to returned obj; make `this` a reference instead
     RRObj move() {
         if(!owner) rr_runtime_error("Trying to move a reference to an object");
-        RRObj new_owner = *this;
+        RRObj new_owner;
+        memcpy(&new_owner, this, sizeof(RRObj));
         this->owner = false;
         new_owner.owner = true; //guaranteed
         return new_owner;
@@ -122,19 +196,38 @@ struct RRObj {
         return new_owner;
     }
     //if owner, do nothing; if not owner, deep clone in place
+    //views are always replaced by a List with a copy of their elements
     void to_owned() {
+        if(type.type == DATATYPE_LIST_VIEW) {
+            RRListView* view = data_view;
+            data_list = view->to_list();
+            type = RRDataType("List");
+            if(owner) delete view;
+            owner = true;
+            return;
+        }
         if(!owner) {
             //not owned, do deep clone
-            if(type == RRDataType("Str")) {
-                data_str = new string(*this->data_str);
-            } else if(type == RRDataType("List")) {
-                data_list = new vector<RRObj>(*this->data_list);
+            switch(type.type) {
+                case DATATYPE_STR:
+                case DATATYPE_STR_BUILDER: data_str = new string(*this->data_str); break;
+                case DATATYPE_LIST: data_list = new vector<RRObj>(*this->data_list); break;
+                case DATATYPE_SLICE: data_slice = new RRSlice(*this->data_slice); break;
+                case DATATYPE_VEC: data_vec = new RRVec(*this->data_vec); break;
+                case DATATYPE_DATA_FRAME: data_frame = new RRDataFrame(*this->data_frame); break;
+                case DATATYPE_MATRIX: data_matrix = new RRMatrix(*this->data_matrix); break;
+                default: break;
             }
             owner = true;
         }
     }
     
     friend std::ostream& operator<<(std::ostream& os, const RRObj& obj) {
+        OutBuffer out(nullptr);
+        out << obj;
+        return os.write(out.data, out.len);
+    }
+    friend OutBuffer& operator<<(OutBuffer& os, const RRObj& obj) {
         switch(obj.type.type) {
             case 0: return os << "Bool: " << obj.data_bool;
             case 1: return os << "Int: " << obj.data_int;
@@ -154,14 +247,23 @@ struct RRObj {
                 return os << "}";
             };
             case 6: {
-                if(obj.data_list->size() == 0) return os << "Vec: []";
+                RRVec* vec = obj.data_vec;
+                if(vec->size() == 0) return os << "Vec: []";
+                //same format as a List, without making an RRObj per element
+                string elem = single_type_of(vec->elem.type) + ": ";
+                bool is_bool = vec->elem == RRDataType("Bool");
+                bool is_float = vec->holds_floats();
+                bool is_str = vec->holds_strs();
+                const long long* ints = vec->int_data();
+                const double* floats = vec->float_data();
                 os << "Vec: [";
-                auto i = obj.data_list->begin();
-                while(true) {
-                    os << *i;
-                    i++;
-                    if(i == obj.data_list->end()) break;
-                    os << ",";
+                for(size_t i = 0; i < vec->size(); i++) {
+                    if(i != 0) os << ",";
+                    os << elem;
+                    if(is_float) os << floats[i];
+                    else if(is_str) os << vec->strs[i];
+                    else if(is_bool) os << (bool) ints[i];
+                    else os << ints[i];
                 }
                 return os << "]";
             };
@@ -180,16 +282,86 @@ struct RRObj {
             case 10: {
                 return os << "None";
             };
+            case 11: {
+                return os << "Expr";
+            };
+            case 12: return os << "StrBuilder: " << *(obj.data_str);
+            case 13: {
+                os << "Slice: " << obj.data_slice->start << ":" << obj.data_slice->stop;
+                if(obj.data_slice->step != 1) os << ":" << obj.data_slice->step;
+                return os;
+            };
+            case 14: {
+                //a view is a List that happens to not own its elements
+                RRListView* view = obj.data_view;
+                if(view->len == 0) return os << "List: []";
+                os << "List: [";
+                for(long long i = 0; i < view->len; i++) {
+                    if(i != 0) os << ",";
+                    os << view->at(i);
+                }
+                return os << "]";
+            };
+            case 15: {
+                RRDataFrame* frame = obj.data_frame;
+                os << "DataFrame: " << (long long) frame->rows() << " rows, columns [";
+                for(int i = 0; i < frame->names.size(); i++) {
+                    if(i != 0) os << ",";
+                    os << frame->names[i] << ": ";
+                    if(frame->columns[i] == nullptr) os << "None";
+                    else os << single_type_of(frame->columns[i]->elem.type);
+                }
+                return os << "]";
+            };
+            case 16: {
+                RRMatrix* matrix = obj.data_matrix;
+                os << "Matrix: [";
+                for(size_t i = 0; i < matrix->rows; i++) {
+                    if(i != 0) os << ",";
+                    os << "[";
+                    for(size_t j = 0; j < matrix->cols; j++) {
+                        if(j != 0) os << ",";
+                        os << matrix->at(i, j);
+                    }
+                    os << "]";
+                }
+                return os << "]";
+            };
             default: return os << "Unhandled type";
         }
     }
 };
+static_assert(sizeof(RRObj) == 16, "RRObj should stay two words; Lists are arrays of them");
+
+RRListView::~RRListView() {
+    if(owns_parent) delete parent;
+    if(owns_indices) delete indices;
+}
+
+long long RRListView::parent_index(long long i) {
+    if(indices != nullptr) return (*indices)[i].data_int;
+    return start + i*step;
+}
+
+RRObj& RRListView::at(long long i) {
+    return (*parent)[parent_index(i)];
+}
+
+vector<RRObj>* RRListView::to_list() {
+    vector<RRObj>* list = new vector<RRObj>();
+    list->reserve(len);
+    for(long long i = 0; i < len; i++) {
+        list->push_back(at(i));
+    }
+    return list;
+}
 
 struct RRFun {
     vector<RRDataType> params;
     RRDataType return_type;
     RRObj (*cpp_fun)(vector<RRObj>&, Env&);
     void* rr_fun;
+    ProfileCounter prof;
 
     RRFun() {}
     RRFun(vector<RRDataType> params, RRDataType return_type, RRObj (*cpp_fun)(vector<RRObj>&, Env&)) {
@@ -197,4 +369,13 @@ struct RRFun {
         this->return_type = return_type;
         this->cpp_fun = cpp_fun;
     }
+
+    //allocations made by the builtin are counted under its return type
+    RRObj call(vector<RRObj>& args, Env& env) {
+        if(!rr_profiling && !rr_mem_stats) return cpp_fun(args, env);
+        MemCategory category(mem_category_of_type(return_type.type));
+        if(!rr_profiling) return cpp_fun(args, env);
+        CallTimer timer(prof);
+        return cpp_fun(args, env);
+    }
 };
\ No newline at end of file
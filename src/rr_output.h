@@ -0,0 +1,104 @@
+// Buffered output for everything the interpreter prints
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+const size_t OUT_BUFFER_SIZE = 1 << 16;
+
+/*
+    Structs
+*/
+
+//collects output and only writes it to `sink` when full or when `flush` is called
+//numbers are formatted with `to_chars`, without going through iostreams
+//with no sink (nullptr), the buffer grows instead and is never written anywhere
+struct OutBuffer {
+    FILE* sink;
+    char* data;
+    size_t len;
+    size_t cap;
+
+    OutBuffer(FILE* sink) {
+        this->sink = sink;
+        this->data = new char[OUT_BUFFER_SIZE];
+        this->len = 0;
+        this->cap = OUT_BUFFER_SIZE;
+    }
+    OutBuffer(const OutBuffer&) = delete;
+    OutBuffer& operator=(const OutBuffer&) = delete;
+    ~OutBuffer() {
+        flush();
+        delete[] data;
+    }
+
+    //write everything in the buffer to the sink
+    void flush() {
+        if(sink == nullptr || len == 0) return;
+        fwrite(data, 1, len, sink);
+        fflush(sink);
+        len = 0;
+    }
+
+    //make sure there is space for `n` more chars
+    void reserve(size_t n) {
+        if(len + n <= cap) return;
+        flush();
+        if(len + n <= cap) return;
+        while(cap < len + n) cap *= 2;
+        char* new_data = new char[cap];
+        memcpy(new_data, data, len);
+        delete[] data;
+        data = new_data;
+    }
+
+    void write(const char* str, size_t n) {
+        reserve(n);
+        memcpy(data + len, str, n);
+        len += n;
+    }
+
+    OutBuffer& operator<<(const char* str) {
+        write(str, strlen(str));
+        return *this;
+    }
+    OutBuffer& operator<<(const string& str) {
+        write(str.data(), str.size());
+        return *this;
+    }
+    OutBuffer& operator<<(char c) {
+        reserve(1);
+        data[len++] = c;
+        return *this;
+    }
+    OutBuffer& operator<<(bool b) {
+        return *this << (b ? '1' : '0');
+    }
+    OutBuffer& operator<<(int num) {
+        return *this << (long long) num;
+    }
+    OutBuffer& operator<<(long long num) {
+        reserve(24);
+        len = to_chars(data + len, data + cap, num).ptr - data;
+        return *this;
+    }
+    //same format as the default for iostreams (`%g`)
+    OutBuffer& operator<<(double num) {
+        reserve(32);
+        len = to_chars(data + len, data + cap, num, chars_format::general, 6).ptr - data;
+        return *this;
+    }
+};
+
+//interpreter output; flushed when the program exits
+//each thread running programs has its own, so their output never interleaves
+thread_local OutBuffer rr_out(stdout);
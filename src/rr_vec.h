@@ -0,0 +1,88 @@
+// Packed collections: Vec (elements of a single type) and DataFrame (named Vec columns)
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "datatypes.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+/*
+    Structs
+*/
+
+//a Vec stores elements of a single type `elem` packed together, without an RRObj per element
+//Int and Bool elements are in `ints`, Float in `floats`, Str in `strs`; the other arrays stay empty
+//a Vec loaded from a file keeps its Int/Float elements in the mapped file instead (`mapped_*`),
+// so read them through `int_data`/`float_data`; nothing changes a Vec's elements in place
+struct RRVec {
+    RRDataType elem;
+    vector<long long> ints;
+    vector<double> floats;
+    vector<string> strs;
+    shared_ptr<MappedFile> mapped; //keeps the file mapped for as long as any Vec uses it
+    const long long* mapped_ints;
+    const double* mapped_floats;
+    size_t mapped_len;
+
+    RRVec(RRDataType elem) {
+        this->elem = elem;
+        this->mapped_ints = nullptr;
+        this->mapped_floats = nullptr;
+        this->mapped_len = 0;
+    }
+
+    size_t size() const {
+        return ints.size() + floats.size() + strs.size() + mapped_len;
+    }
+    bool holds_floats() const {
+        return elem == RRDataType("Float");
+    }
+    bool holds_strs() const {
+        return elem == RRDataType("Str");
+    }
+    const long long* int_data() const {
+        return mapped_ints != nullptr ? mapped_ints : ints.data();
+    }
+    const double* float_data() const {
+        return mapped_floats != nullptr ? mapped_floats : floats.data();
+    }
+};
+
+//a table of named Vec columns, all of the same length
+struct RRDataFrame {
+    vector<string> names;
+    vector<RRVec*> columns; //owned; nullptr once a column has been given away by indexing into a temporary frame
+
+    RRDataFrame() {}
+    RRDataFrame(const RRDataFrame& from) {
+        names = from.names;
+        for(int i = 0; i < from.columns.size(); i++) {
+            columns.push_back(from.columns[i] == nullptr ? nullptr : new RRVec(*from.columns[i]));
+        }
+    }
+    ~RRDataFrame() {
+        for(int i = 0; i < columns.size(); i++) {
+            delete columns[i];
+        }
+    }
+
+    size_t rows() const {
+        for(int i = 0; i < columns.size(); i++) {
+            if(columns[i] != nullptr) return columns[i]->size();
+        }
+        return 0;
+    }
+
+    //index of column `name`; -1 if there is none
+    int column_of(const string& name) const {
+        for(int i = 0; i < names.size(); i++) {
+            if(names[i] == name) return i;
+        }
+        return -1;
+    }
+};
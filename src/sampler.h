@@ -0,0 +1,133 @@
+// Sampling profiler: a timer signal records which AST nodes are being evaluated, about a thousand times a second
+// Enabled by running with `--sample <file>`; the samples are written to the file as folded stacks
+// (`outermost;...;innermost count` on each line), which flamegraph tools take as input.
+// Unlike `--profile`, nothing is timed per node: evaluation only pushes and pops the node on a small stack.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <signal.h>
+#include <sys/time.h>
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//CPU time between samples
+const int SAMPLE_INTERVAL_US = 1000;
+//deeper stacks are cut off at this many outer frames
+const int SAMPLE_MAX_DEPTH = 512;
+//samples past these limits are dropped (and counted); the buffers are only touched as they fill up
+const size_t SAMPLE_MAX_SAMPLES = 1 << 22;
+const size_t SAMPLE_MAX_FRAMES = 1 << 25;
+
+bool rr_sampling = false;
+
+/*
+    Structs
+*/
+
+//the frames being evaluated, outermost first
+//written only by the interpreter thread; the signal may be handled on any thread, so it's read with atomics
+struct SampleStack {
+    atomic<const void*> frames[SAMPLE_MAX_DEPTH];
+    atomic<int> depth;
+};
+
+//all samples taken: frames of each sample are stored back to back in `frames`, and its depth in `depths`
+//only the signal handler writes here while sampling, so everything is allocated up front
+struct SampleLog {
+    unique_ptr<const void*[]> frames;
+    unique_ptr<int[]> depths;
+    size_t used_frames = 0;
+    size_t samples = 0;
+    unsigned long long dropped = 0;
+};
+
+SampleStack sample_stack;
+SampleLog sample_log;
+
+//pushes `frame` onto the sample stack for as long as it lives
+struct SampleFrame {
+    SampleFrame(const void* frame) {
+        int depth = sample_stack.depth.load(memory_order_relaxed);
+        if(depth < SAMPLE_MAX_DEPTH) sample_stack.frames[depth].store(frame, memory_order_relaxed);
+        sample_stack.depth.store(depth + 1, memory_order_release);
+    }
+    ~SampleFrame() {
+        sample_stack.depth.store(sample_stack.depth.load(memory_order_relaxed) - 1, memory_order_release);
+    }
+};
+
+/*
+    Functions
+*/
+
+//copy the current stack into the log; only does async-signal-safe work
+void take_sample(int) {
+    int depth = min(sample_stack.depth.load(memory_order_acquire), SAMPLE_MAX_DEPTH);
+    if(depth <= 0) return;
+    if(sample_log.samples == SAMPLE_MAX_SAMPLES || sample_log.used_frames + depth > SAMPLE_MAX_FRAMES) {
+        sample_log.dropped++;
+        return;
+    }
+    const void** out = sample_log.frames.get() + sample_log.used_frames;
+    for(int i = 0; i < depth; i++) out[i] = sample_stack.frames[i].load(memory_order_relaxed);
+    sample_log.depths[sample_log.samples++] = depth;
+    sample_log.used_frames += depth;
+}
+
+void set_sample_timer(int interval_us) {
+    itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = interval_us;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void start_sampling() {
+    sample_log.frames.reset(new const void*[SAMPLE_MAX_FRAMES]);
+    sample_log.depths.reset(new int[SAMPLE_MAX_SAMPLES]);
+    struct sigaction action = {};
+    action.sa_handler = take_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+    rr_sampling = true;
+    set_sample_timer(SAMPLE_INTERVAL_US);
+}
+
+void stop_sampling() {
+    set_sample_timer(0);
+    signal(SIGPROF, SIG_IGN);
+    rr_sampling = false;
+}
+
+//write the samples to `out` as folded stacks, sorted, with the number of samples of each stack
+//`frame_name` names a frame; names must not contain `;` or newlines
+void write_folded_stacks(FILE* out, string (*frame_name)(const void*)) {
+    unordered_map<const void*, string> names;
+    map<string, unsigned long long> stacks;
+    const void** frames = sample_log.frames.get();
+    for(size_t s = 0; s < sample_log.samples; s++) {
+        string stack;
+        for(int i = 0; i < sample_log.depths[s]; i++) {
+            auto name = names.find(frames[i]);
+            if(name == names.end()) name = names.emplace(frames[i], frame_name(frames[i])).first;
+            if(i > 0) stack += ';';
+            stack += name->second;
+        }
+        stacks[stack]++;
+        frames += sample_log.depths[s];
+    }
+    for(auto& stack : stacks) fprintf(out, "%s %llu\n", stack.first.c_str(), stack.second);
+}
@@ -0,0 +1,285 @@
+// Server mode: evaluates scripts sent over a Unix domain socket, without starting a process per script
+// Run with `--serve <socket path>` (and `--workers N`); `--connect <socket path>` sends stdin as one request.
+// A connection sends any number of requests, one after the other: a line with the size of the source in bytes,
+// then the source. Each response is a line `ok|error bytes=<n> cached=<0|1> parse_us=<us> eval_us=<us>`,
+// then `n` bytes of output: exactly what `a.out` would have printed for the same source.
+// Compiled programs are cached by source, so a script sent again skips tokenizing and parsing. Requests are
+// evaluated by a pool of worker threads, each with its own Env that is emptied after every request.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "environment.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//compiled programs kept; the oldest one is dropped to make room for a new one
+const size_t SERVE_CACHE_PROGRAMS = 256;
+//bigger requests close the connection
+const size_t SERVE_MAX_SOURCE = 1 << 28;
+const int SERVE_BACKLOG = 64;
+
+/*
+    Structs
+*/
+
+//a parsed program; released when it's out of the cache and no request is running it anymore
+struct ServedProgram {
+    ASTNode* root;
+
+    ServedProgram(ASTNode* root) : root(root) {}
+    ~ServedProgram() {
+        delete_ast(root);
+    }
+};
+
+//compiled programs by their source
+struct ProgramCache {
+    mutex lock;
+    unordered_map<string, shared_ptr<ServedProgram>> programs;
+    deque<string> order; //sources, oldest first
+
+    shared_ptr<ServedProgram> find(const string& source) {
+        lock_guard<mutex> guard(lock);
+        auto program = programs.find(source);
+        return program == programs.end() ? nullptr : program->second;
+    }
+
+    //cache `program` for `source`; if another worker cached it first, that one is kept and returned
+    shared_ptr<ServedProgram> insert(const string& source, shared_ptr<ServedProgram> program) {
+        lock_guard<mutex> guard(lock);
+        auto cached = programs.emplace(source, program);
+        if(!cached.second) return cached.first->second;
+        order.push_back(source);
+        if(order.size() > SERVE_CACHE_PROGRAMS) {
+            programs.erase(order.front());
+            order.pop_front();
+        }
+        return program;
+    }
+};
+
+//accepted connections waiting for a worker
+struct ConnectionQueue {
+    mutex lock;
+    condition_variable ready;
+    deque<int> fds;
+
+    void push(int fd) {
+        {
+            lock_guard<mutex> guard(lock);
+            fds.push_back(fd);
+        }
+        ready.notify_one();
+    }
+    int pop() {
+        unique_lock<mutex> guard(lock);
+        ready.wait(guard, [this]() { return !fds.empty(); });
+        int fd = fds.front();
+        fds.pop_front();
+        return fd;
+    }
+};
+
+//buffered reads from a socket
+struct SocketReader {
+    int fd;
+    char buf[1 << 16];
+    size_t at = 0;
+    size_t len = 0;
+
+    SocketReader(int fd) : fd(fd) {}
+
+    //false once the other side is gone
+    bool fill() {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0) return false;
+        at = 0;
+        len = n;
+        return true;
+    }
+    bool line(string& out) {
+        out.clear();
+        while(true) {
+            if(at == len && !fill()) return false;
+            char* end = (char*) memchr(buf + at, '\n', len - at);
+            if(end != nullptr) {
+                out.append(buf + at, end - (buf + at));
+                at = end - buf + 1;
+                return true;
+            }
+            out.append(buf + at, len - at);
+            at = len;
+            if(out.size() > 32) return false; //not a length
+        }
+    }
+    bool bytes(string& out, size_t n) {
+        out.clear();
+        out.reserve(n);
+        while(out.size() < n) {
+            if(at == len && !fill()) return false;
+            size_t take = min(n - out.size(), len - at);
+            out.append(buf + at, take);
+            at += take;
+        }
+        return true;
+    }
+};
+
+/*
+    Functions
+*/
+
+bool write_all(int fd, const char* data, size_t n) {
+    while(n > 0) {
+        ssize_t written = send(fd, data, n, MSG_NOSIGNAL);
+        if(written <= 0) return false;
+        data += written;
+        n -= written;
+    }
+    return true;
+}
+
+long long serve_elapsed_us(chrono::steady_clock::time_point since) {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - since).count();
+}
+
+//evaluate `source` in `env`, printing into this thread's output buffer; the response header line is returned
+string serve_request(const string& source, Env& env, ProgramCache& cache) {
+    auto start = chrono::steady_clock::now();
+    long long parse_us = 0;
+    shared_ptr<ServedProgram> program = cache.find(source);
+    bool cached = program != nullptr;
+    bool ok = true;
+    bool parsed = cached;
+    try {
+        if(!cached) {
+            vector<Token> tokens = Tokenizer::from_source(source).tokenize();
+            program = cache.insert(source, make_shared<ServedProgram>(Parser::from_tokens(tokens).parse(env)));
+            parse_us = serve_elapsed_us(start);
+            parsed = true;
+        }
+        start = chrono::steady_clock::now();
+        RRObj res = program->root->eval(env);
+        rr_out << res << '\n';
+    } catch(RRError& error) {
+        report_error(error);
+        ok = false;
+    } catch(bad_alloc&) {
+        report_error(RRError(false, "Out of memory"));
+        ok = false;
+    } catch(exception& error) {
+        //anything else thrown by the standard library fails the request, not the server
+        report_error(RRError(false, error.what()));
+        ok = false;
+    }
+    long long eval_us = parsed ? serve_elapsed_us(start) : 0;
+    env.vars.clear();
+    return (ok ? "ok"s : "error"s) + " bytes=" + to_string(rr_out.len) + " cached=" + (cached ? "1" : "0")
+        + " parse_us=" + to_string(parse_us) + " eval_us=" + to_string(eval_us) + "\n";
+}
+
+//answer requests on connection `fd` until it's closed
+void serve_connection(int fd, Env& env, ProgramCache& cache) {
+    SocketReader reader(fd);
+    string header;
+    string source;
+    while(reader.line(header)) {
+        char* end;
+        unsigned long long size = strtoull(header.c_str(), &end, 10);
+        if(end == header.c_str() || *end != '\0' || size > SERVE_MAX_SOURCE) break;
+        if(!reader.bytes(source, size)) break;
+        //every request starts like a fresh process would: no variables, and the default random seed
+        rr_random = RRRandom();
+        string response = serve_request(source, env, cache);
+        bool sent = write_all(fd, response.data(), response.size()) && write_all(fd, rr_out.data, rr_out.len);
+        rr_out.len = 0;
+        if(!sent) break;
+    }
+    close(fd);
+}
+
+void serve_worker(ConnectionQueue& queue, ProgramCache& cache) {
+    rr_out.sink = nullptr; //output is collected for the response instead
+    Env env = Env();
+    Env::init_with_default(env);
+    while(true) serve_connection(queue.pop(), env, cache);
+}
+
+//listen on the Unix socket at `path` and serve requests forever; returns only if the socket can't be set up
+int serve(const string& path, int workers) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "--serve: socket path '%s' is too long\n", path.c_str());
+        return 1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str()); //a socket left behind by an earlier server
+    if(listener < 0 || bind(listener, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(listener, SERVE_BACKLOG) != 0) {
+        fprintf(stderr, "--serve: cannot listen on '%s': %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    ConnectionQueue queue;
+    ProgramCache cache;
+    if(workers <= 0) workers = max(1u, thread::hardware_concurrency());
+    for(int i = 0; i < workers; i++) thread(serve_worker, ref(queue), ref(cache)).detach();
+    fprintf(stderr, "--serve: listening on '%s' with %d workers\n", path.c_str(), workers);
+    while(true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if(fd >= 0) queue.push(fd);
+    }
+}
+
+//send `source` to the server at `path` as one request; the output goes to stdout, and the timing to stderr
+int serve_client(const string& path, const string& source) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "--connect: cannot connect to '%s': %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+    string request = to_string(source.size()) + "\n" + source;
+    SocketReader reader(fd);
+    string header;
+    string output;
+    if(!write_all(fd, request.data(), request.size()) || !reader.line(header)) {
+        fprintf(stderr, "--connect: the server closed the connection\n");
+        return 1;
+    }
+    const char* bytes = strstr(header.c_str(), "bytes=");
+    if(bytes == nullptr || !reader.bytes(output, strtoull(bytes + 6, nullptr, 10))) {
+        fprintf(stderr, "--connect: bad response '%s'\n", header.c_str());
+        return 1;
+    }
+    close(fd);
+    fwrite(output.data(), 1, output.size(), stdout);
+    fprintf(stderr, "--connect: %s\n", header.c_str());
+    return header.compare(0, 3, "ok ") == 0 ? 0 : 1;
+}
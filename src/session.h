@@ -0,0 +1,317 @@
+// Session mode: keeps a script's variables between edits, and runs again only what an edit changed
+// Run with `--session <file>`: the file is run once, then again every time it's saved. Each top-level statement
+// remembers which variables it reads and which it assigns (`append(b, x)` assigns `b`), and the value it gave. After an edit, only the
+// statements that changed and the ones depending on them (through the variables they read) are evaluated again,
+// so a statement that loads a big file runs again only when it, or something it reads, is edited.
+// The variables end up as if the whole script was run again, except for what `random` and reading files give:
+// they are only called again when their statement runs again.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "environment.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//how often the script is checked for changes
+const int SESSION_POLL_MS = 100;
+//builtins that change their first argument in place; the variable given to one is assigned by the call
+const unordered_set<string> SESSION_IN_PLACE_FUNS = {"append"};
+
+/*
+    Structs
+*/
+
+//a top-level statement of the script, and what it did the last time it ran
+struct SessionStatement {
+    ASTNode* node;
+    string key; //the statement's code, without positions; equal keys mean the same statement
+    vector<string> reads;
+    vector<string> writes; //assigned variables, including Lists assigned into (`a[0] = 1` writes `a`) and builders appended to
+    string result; //its value, as printed
+    bool stale = true; //has to run on the next update: it's new, or it didn't finish last time
+};
+
+//what an update ran
+struct SessionUpdate {
+    bool ok = true;
+    int statements = 0;
+    vector<int> lines; //of the statements that ran
+    double ms = 0;
+};
+
+struct Session {
+    Env env;
+    vector<SessionStatement> statements;
+
+    Session() {
+        Env::init_with_default(env);
+    }
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    ~Session() {
+        for(int i = 0; i < statements.size(); i++) delete_ast(statements[i].node);
+    }
+
+    //bring the variables up to date with the new version of the script, running as few statements as possible;
+    // prints the value of the last statement, like a normal run. Parse errors are thrown, and change nothing
+    SessionUpdate update(const string& source);
+
+    //which statements of `fresh` to run, given the variables that no longer hold a value from the script
+    vector<bool> plan_runs(vector<SessionStatement>& fresh, unordered_set<string>& dropped);
+};
+
+/*
+    Functions
+*/
+
+//append what `node` does to `key`; positions and the source's formatting are left out
+void statement_key(ASTNode* node, string& key) {
+    key += (char) ('A' + node->type);
+    switch(node->type) {
+        case ASTType::LITERAL: {
+            RRObj& value = node->literal;
+            string bytes;
+            if(value.type == RRDataType("Int")) bytes.assign((char*) &value.data_int, sizeof(value.data_int));
+            else if(value.type == RRDataType("Float")) bytes.assign((char*) &value.data_float, sizeof(value.data_float));
+            else if(value.type == RRDataType("Bool")) bytes = value.data_bool ? "1" : "0";
+            else if(value.type == RRDataType("Str")) bytes = *value.data_str;
+            else {
+                OutBuffer out(nullptr);
+                out << value;
+                bytes.assign(out.data, out.len);
+            }
+            //the length first, so a literal never runs into the next node
+            key += single_type_of(value.type.type) + ":" + to_string(bytes.size()) + ":" + bytes;
+        }; break;
+        case ASTType::VAR:
+        case ASTType::FUN:
+        case ASTType::OP: {
+            key += node->symbol;
+            key += '\0';
+        }; break;
+        default: break;
+    }
+    key += to_string(node->children.size());
+    key += '(';
+    for(int i = 0; i < node->children.size(); i++) statement_key(node->children[i], key);
+    key += ')';
+}
+
+//the variable holding what `target` changes: `a` for `a`, `a[i][j]` or `{...; a}`; nullptr if there's none
+ASTNode* changed_var(ASTNode* target) {
+    while(target->type == ASTType::INDEX || (target->type == ASTType::STATEMENT && !target->children.empty())) {
+        target = target->type == ASTType::INDEX ? target->children[0] : target->children.back();
+    }
+    return target->type == ASTType::VAR ? target : nullptr;
+}
+
+//the variables that `node` reads and assigns
+void collect_vars(ASTNode* node, vector<string>& reads, vector<string>& writes) {
+    if(node->type == ASTType::OP && node->symbol == "=" && node->children.size() == 2) {
+        ASTNode* target = node->children[0];
+        //`a[i] = v` changes `a` in place, so it reads `a` (and `i`) too
+        if(target->type != ASTType::VAR) collect_vars(target, reads, writes);
+        ASTNode* var = changed_var(target);
+        if(var != nullptr) writes.push_back(var->symbol);
+        collect_vars(node->children[1], reads, writes);
+        return;
+    }
+    if(node->type == ASTType::EVALUATE && node->children.size() == 2 && node->children[0]->type == ASTType::FUN
+        && SESSION_IN_PLACE_FUNS.count(node->children[0]->symbol) > 0 && !node->children[1]->children.empty()) {
+        //`append(b, x)` changes `b` in place, like `b = b + x` would
+        ASTNode* var = changed_var(node->children[1]->children[0]);
+        if(var != nullptr) writes.push_back(var->symbol);
+    }
+    if(node->type == ASTType::VAR) reads.push_back(node->symbol);
+    for(int i = 0; i < node->children.size(); i++) collect_vars(node->children[i], reads, writes);
+}
+
+void sort_unique(vector<string>& names) {
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+}
+
+vector<bool> Session::plan_runs(vector<SessionStatement>& fresh, unordered_set<string>& dropped) {
+    //the statements assigning each variable, in order
+    unordered_map<string, vector<int>> writers;
+    for(int i = 0; i < fresh.size(); i++) {
+        for(int w = 0; w < fresh[i].writes.size(); w++) writers[fresh[i].writes[w]].push_back(i);
+    }
+    vector<bool> forced(fresh.size(), false);
+    vector<bool> runs;
+    bool replan = true;
+    while(replan) {
+        replan = false;
+        runs.assign(fresh.size(), false);
+        //variables that get a new value from the statements run so far; everything reading or assigning them runs too
+        unordered_set<string> dirty = dropped;
+        for(int i = 0; i < fresh.size() && !replan; i++) {
+            SessionStatement& statement = fresh[i];
+            bool run = statement.stale || forced[i];
+            for(int r = 0; !run && r < statement.reads.size(); r++) run = dirty.count(statement.reads[r]) > 0;
+            for(int w = 0; !run && w < statement.writes.size(); w++) run = dirty.count(statement.writes[w]) > 0;
+            if(!run) continue;
+            runs[i] = true;
+            for(int r = 0; r < statement.reads.size(); r++) {
+                const string& name = statement.reads[r];
+                if(dirty.count(name) > 0 || writers.count(name) == 0) continue;
+                //the variable holds what the script's last assignment gave it; if that's at or after this statement,
+                // the value this statement should see has to be assigned again first
+                vector<int>& assigned_at = writers[name];
+                if(assigned_at.back() < i) continue;
+                auto before = lower_bound(assigned_at.begin(), assigned_at.end(), i);
+                if(before == assigned_at.begin()) dropped.insert(name); //not assigned yet at this point of the script
+                else forced[*(before - 1)] = true;
+                replan = true;
+            }
+            for(int w = 0; w < statement.writes.size(); w++) dirty.insert(statement.writes[w]);
+        }
+    }
+    return runs;
+}
+
+SessionUpdate Session::update(const string& source) {
+    auto start = chrono::steady_clock::now();
+    vector<Token> tokens = Tokenizer::from_source(source).tokenize();
+    ASTNode* root;
+    {
+        MemCategory category(MEM_AST);
+        root = Parser::from_tokens(tokens).parse(env);
+    }
+    vector<SessionStatement> fresh(root->children.size());
+    for(int i = 0; i < fresh.size(); i++) {
+        SessionStatement& statement = fresh[i];
+        statement.node = root->children[i];
+        statement_key(statement.node, statement.key);
+        collect_vars(statement.node, statement.reads, statement.writes);
+        sort_unique(statement.reads);
+        sort_unique(statement.writes);
+    }
+    root->children.clear();
+    delete root;
+
+    //statements that are still there keep their results; they're matched in order, so moving one runs it again
+    unordered_map<string, vector<int>> old_at;
+    for(int i = 0; i < statements.size(); i++) old_at[statements[i].key].push_back(i);
+    vector<bool> kept(statements.size(), false);
+    int next_old = 0;
+    for(int i = 0; i < fresh.size(); i++) {
+        auto same = old_at.find(fresh[i].key);
+        if(same == old_at.end()) continue;
+        auto at = lower_bound(same->second.begin(), same->second.end(), next_old);
+        if(at == same->second.end()) continue;
+        SessionStatement& old = statements[*at];
+        fresh[i].result = old.result;
+        fresh[i].stale = old.stale;
+        kept[*at] = true;
+        next_old = *at + 1;
+    }
+    //variables assigned by statements that are gone no longer have their value
+    unordered_set<string> dropped;
+    for(int i = 0; i < statements.size(); i++) {
+        if(kept[i]) continue;
+        for(int w = 0; w < statements[i].writes.size(); w++) dropped.insert(statements[i].writes[w]);
+    }
+
+    vector<bool> runs = plan_runs(fresh, dropped);
+    for(auto name = dropped.begin(); name != dropped.end(); name++) env.vars.erase(*name);
+    for(int i = 0; i < statements.size(); i++) delete_ast(statements[i].node);
+    statements = move(fresh);
+
+    SessionUpdate update;
+    for(int i = 0; i < statements.size(); i++) {
+        if(!runs[i]) continue;
+        SessionStatement& statement = statements[i];
+        update.statements++;
+        update.lines.push_back(statement.node->line);
+        try {
+            release_replaced();
+            RRObj value = statement.node->eval(env);
+            OutBuffer out(nullptr);
+            out << value;
+            statement.result = string(out.data, out.len);
+            statement.stale = false;
+        } catch(exception& error) { //RRError, or anything thrown by the standard library
+            rr_out << "--RR: Runtime error: " << error.what() << " (line " << statement.node->line << ")\n";
+            //this statement and the ones after it that should have run are run on the next update
+            for(int j = i; j < statements.size(); j++) statements[j].stale = statements[j].stale || runs[j];
+            update.ok = false;
+            break;
+        }
+    }
+    if(update.ok) {
+        if(statements.empty()) rr_out << RRObj() << '\n';
+        else rr_out << statements.back().result << '\n';
+    }
+    rr_out.flush();
+    update.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return update;
+}
+
+//the contents of the file at `path`; false if it can't be read
+bool read_script(const string& path, string& source) {
+    ifstream file(path);
+    if(!file) return false;
+    stringstream contents;
+    contents << file.rdbuf();
+    source = contents.str();
+    if(source.empty() || source.back() != '\n') source += '\n';
+    return true;
+}
+
+//run the script at `path`, then update the session every time it changes; returns only if it can't be read
+int run_session(const string& path) {
+    init_datatypes();
+    Session session;
+    string source;
+    timespec modified = {};
+    bool first = true;
+    while(true) {
+        struct stat info;
+        bool changed = stat(path.c_str(), &info) == 0
+            && (first || info.st_mtim.tv_sec != modified.tv_sec || info.st_mtim.tv_nsec != modified.tv_nsec);
+        if(changed) {
+            modified = info.st_mtim;
+            string edited;
+            if(!read_script(path, edited)) {
+                if(first) break;
+            } else if(first || edited != source) {
+                source = edited;
+                try {
+                    SessionUpdate update = session.update(source);
+                    fprintf(stderr, "--session: ran %d of %d statements in %.1f ms", update.statements,
+                        (int) session.statements.size(), update.ms);
+                    for(int i = 0; i < update.lines.size(); i++) fprintf(stderr, "%s%d", i == 0 ? " (lines " : ", ", update.lines[i]);
+                    fprintf(stderr, "%s\n", update.lines.empty() ? "" : ")");
+                } catch(exception& error) {
+                    rr_out << "--RR: Error while parsing: " << error.what() << '\n';
+                    rr_out.flush();
+                }
+            }
+            first = false;
+        }
+        if(first) break;
+        usleep(SESSION_POLL_MS * 1000);
+    }
+    fprintf(stderr, "--session: cannot read '%s'\n", path.c_str());
+    return 1;
+}
@@ -0,0 +1,384 @@
+// Sorting Vecs and DataFrames, and joining DataFrames on a key column
+// Int, Bool and Float elements are radix sorted on order-preserving 64 bit keys; Str elements are sorted by comparison.
+// Lists of mixed numbers and strings are sorted by comparison too, numbers first.
+// Every sort is stable, so `argsort` gives equal elements in their original order.
+// Big numeric inputs are split into chunks that are sorted on separate threads, then merged pairwise in parallel.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "datatypes.h"
+#include "rr_obj.h"
+#include "rr_vec.h"
+#include "group_by.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//numeric inputs with fewer elements than this are sorted on a single thread
+const size_t SORT_MIN_PARALLEL_ROWS = 1 << 22;
+
+//bits sorted per radix pass
+const int RADIX_BITS = 11;
+const size_t RADIX_SIZE = 1 << RADIX_BITS;
+
+/*
+    Functions
+*/
+
+//a key that orders like the Int `num` when compared as unsigned
+uint64_t sort_key_int(long long num) {
+    return (uint64_t) num ^ (1ULL << 63);
+}
+long long int_of_sort_key(uint64_t key) {
+    return (long long) (key ^ (1ULL << 63));
+}
+
+//a key that orders like the Float `num` when compared as unsigned; NaN comes last
+uint64_t sort_key_float(double num) {
+    if(isnan(num)) num = NAN;
+    uint64_t bits;
+    memcpy(&bits, &num, 8);
+    return (bits >> 63) ? ~bits : bits ^ (1ULL << 63);
+}
+double float_of_sort_key(uint64_t key) {
+    uint64_t bits = (key >> 63) ? key ^ (1ULL << 63) : ~key;
+    double num;
+    memcpy(&num, &bits, 8);
+    return num;
+}
+
+//stable LSD radix sort of `keys[0..n)`; `idx` (if not nullptr) is moved along with the keys
+//passes over digits that are the same for every key are skipped
+void radix_sort(uint64_t* keys, size_t* idx, size_t n) {
+    vector<uint64_t> key_buf(n);
+    vector<size_t> idx_buf(idx != nullptr ? n : 0);
+    uint64_t* from_keys = keys;
+    uint64_t* to_keys = key_buf.data();
+    size_t* from_idx = idx;
+    size_t* to_idx = idx_buf.data();
+    vector<size_t> counts(RADIX_SIZE);
+    for(int shift = 0; shift < 64; shift += RADIX_BITS) {
+        fill(counts.begin(), counts.end(), 0);
+        for(size_t i = 0; i < n; i++) counts[(from_keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        if(n == 0 || counts[(from_keys[0] >> shift) & (RADIX_SIZE - 1)] == n) continue;
+        size_t sum = 0;
+        for(size_t d = 0; d < RADIX_SIZE; d++) {
+            size_t count = counts[d];
+            counts[d] = sum;
+            sum += count;
+        }
+        for(size_t i = 0; i < n; i++) {
+            size_t at = counts[(from_keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+            to_keys[at] = from_keys[i];
+            if(idx != nullptr) to_idx[at] = from_idx[i];
+        }
+        swap(from_keys, to_keys);
+        swap(from_idx, to_idx);
+    }
+    if(from_keys != keys) {
+        memcpy(keys, from_keys, n * sizeof(uint64_t));
+        if(idx != nullptr) memcpy(idx, from_idx, n * sizeof(size_t));
+    }
+}
+
+//stable merge of sorted runs [a, b) and [b, c) of `keys`/`idx` into `out_keys`/`out_idx`
+void sort_merge_runs(const uint64_t* keys, const size_t* idx, size_t a, size_t b, size_t c, uint64_t* out_keys, size_t* out_idx) {
+    size_t i = a, j = b, at = a;
+    while(i < b && j < c) {
+        if(keys[j] < keys[i]) {
+            out_keys[at] = keys[j];
+            if(idx != nullptr) out_idx[at] = idx[j];
+            j++;
+        } else {
+            out_keys[at] = keys[i];
+            if(idx != nullptr) out_idx[at] = idx[i];
+            i++;
+        }
+        at++;
+    }
+    memcpy(out_keys + at, keys + i, (b - i) * sizeof(uint64_t));
+    memcpy(out_keys + at + (b - i), keys + j, (c - j) * sizeof(uint64_t));
+    if(idx != nullptr) {
+        memcpy(out_idx + at, idx + i, (b - i) * sizeof(size_t));
+        memcpy(out_idx + at + (b - i), idx + j, (c - j) * sizeof(size_t));
+    }
+}
+
+//stable sort of `keys` (and `idx`, if not empty), radix sorting chunks in parallel for big inputs
+void sort_keys(vector<uint64_t>& keys, vector<size_t>& idx) {
+    size_t n = keys.size();
+    size_t* idx_data = idx.empty() ? nullptr : idx.data();
+    size_t nchunks = min((size_t) thread::hardware_concurrency(), n / SORT_MIN_PARALLEL_ROWS);
+    if(nchunks <= 1) {
+        radix_sort(keys.data(), idx_data, n);
+        return;
+    }
+
+    vector<size_t> bounds;
+    for(size_t i = 0; i <= nchunks; i++) bounds.push_back(n * i / nchunks);
+    vector<thread> workers;
+    for(size_t i = 0; i < nchunks; i++) {
+        workers.push_back(thread(radix_sort, keys.data() + bounds[i], idx_data == nullptr ? nullptr : idx_data + bounds[i], bounds[i+1] - bounds[i]));
+    }
+    for(int i = 0; i < workers.size(); i++) workers[i].join();
+
+    //merge neighbouring runs until one is left
+    vector<uint64_t> key_buf(n);
+    vector<size_t> idx_buf(idx.size());
+    while(bounds.size() > 2) {
+        workers.clear();
+        vector<size_t> merged_bounds;
+        for(size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            merged_bounds.push_back(bounds[i]);
+            size_t a = bounds[i], b = bounds[i+1], c = i + 2 < bounds.size() ? bounds[i+2] : b;
+            workers.push_back(thread(sort_merge_runs, keys.data(), idx_data, a, b, c, key_buf.data(), idx_buf.data()));
+        }
+        merged_bounds.push_back(n);
+        for(int i = 0; i < workers.size(); i++) workers[i].join();
+        keys.swap(key_buf);
+        idx.swap(idx_buf);
+        idx_data = idx.empty() ? nullptr : idx.data();
+        bounds = merged_bounds;
+    }
+}
+
+//order-preserving keys of the Int/Bool/Float elements of `vec`
+vector<uint64_t> vec_sort_keys(const RRVec& vec) {
+    size_t n = vec.size();
+    vector<uint64_t> keys(n);
+    if(vec.holds_floats()) {
+        const double* floats = vec.float_data();
+        for(size_t i = 0; i < n; i++) keys[i] = sort_key_float(floats[i]);
+    } else {
+        const long long* ints = vec.int_data();
+        for(size_t i = 0; i < n; i++) keys[i] = sort_key_int(ints[i]);
+    }
+    return keys;
+}
+
+//positions of the elements of `vec` in sorted order
+vector<size_t> vec_argsort(const RRVec& vec) {
+    size_t n = vec.size();
+    vector<size_t> idx(n);
+    for(size_t i = 0; i < n; i++) idx[i] = i;
+    if(vec.holds_strs()) {
+        const vector<string>& strs = vec.strs;
+        stable_sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return strs[a] < strs[b]; });
+        return idx;
+    }
+    vector<uint64_t> keys = vec_sort_keys(vec);
+    sort_keys(keys, idx);
+    return idx;
+}
+
+//a new Vec of the elements of `vec`, in sorted order
+RRVec* vec_sorted(const RRVec& vec) {
+    RRVec* res = new RRVec(vec.elem);
+    if(vec.holds_strs()) {
+        res->strs = vec.strs;
+        sort(res->strs.begin(), res->strs.end());
+        return res;
+    }
+    vector<uint64_t> keys = vec_sort_keys(vec);
+    vector<size_t> no_idx;
+    sort_keys(keys, no_idx);
+    size_t n = keys.size();
+    if(vec.holds_floats()) {
+        res->floats.resize(n);
+        for(size_t i = 0; i < n; i++) res->floats[i] = float_of_sort_key(keys[i]);
+    } else {
+        res->ints.resize(n);
+        for(size_t i = 0; i < n; i++) res->ints[i] = int_of_sort_key(keys[i]);
+    }
+    return res;
+}
+
+//a new Vec of the elements of `vec` at `rows`, in that order
+RRVec* vec_gather(const RRVec& vec, const vector<size_t>& rows) {
+    RRVec* res = new RRVec(vec.elem);
+    size_t n = rows.size();
+    if(vec.holds_strs()) {
+        res->strs.reserve(n);
+        for(size_t i = 0; i < n; i++) res->strs.push_back(vec.strs[rows[i]]);
+    } else if(vec.holds_floats()) {
+        const double* floats = vec.float_data();
+        res->floats.resize(n);
+        for(size_t i = 0; i < n; i++) res->floats[i] = floats[rows[i]];
+    } else {
+        const long long* ints = vec.int_data();
+        res->ints.resize(n);
+        for(size_t i = 0; i < n; i++) res->ints[i] = ints[rows[i]];
+    }
+    return res;
+}
+
+//positions of the elements of `list` in sorted order: Bool, Int and Float by value (NaN last), then Str
+vector<size_t> list_argsort(const vector<RRObj>& list) {
+    int bool_t = RRDataType("Bool").type;
+    int int_t = RRDataType("Int").type;
+    int float_t = RRDataType("Float").type;
+    int str_t = RRDataType("Str").type;
+    for(int i = 0; i < list.size(); i++) {
+        int t = list[i].type.type;
+        if(t != bool_t && t != int_t && t != float_t && t != str_t) rr_runtime_error("Cannot sort a List with elements of type "s + single_type_of(t));
+    }
+    auto num = [&](const RRObj& obj) {
+        if(obj.type.type == float_t) return obj.data_float;
+        if(obj.type.type == int_t) return (double) obj.data_int;
+        return (double) obj.data_bool;
+    };
+    auto less = [&](const RRObj& a, const RRObj& b) {
+        bool a_str = a.type.type == str_t;
+        bool b_str = b.type.type == str_t;
+        if(a_str || b_str) return a_str && b_str ? *a.data_str < *b.data_str : b_str;
+        if(a.type.type == int_t && b.type.type == int_t) return a.data_int < b.data_int;
+        double x = num(a), y = num(b);
+        return !isnan(x) && (isnan(y) || x < y);
+    };
+    vector<size_t> idx(list.size());
+    for(size_t i = 0; i < idx.size(); i++) idx[i] = i;
+    stable_sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return less(list[a], list[b]); });
+    return idx;
+}
+
+//positions of the first of every distinct element of `list`, in order; equal elements have the same type and value
+//(Floats compare like `unique` on a Vec: all NaNs are one element, and so are 0.0 and -0.0)
+vector<size_t> list_unique_rows(const vector<RRObj>& list) {
+    int bool_t = RRDataType("Bool").type;
+    int int_t = RRDataType("Int").type;
+    int float_t = RRDataType("Float").type;
+    int str_t = RRDataType("Str").type;
+    unordered_set<string> seen;
+    vector<size_t> rows;
+    for(size_t i = 0; i < list.size(); i++) {
+        int t = list[i].type.type;
+        string key(1, (char) t);
+        if(t == int_t) key.append((const char*) &list[i].data_int, 8);
+        else if(t == bool_t) key += list[i].data_bool ? '1' : '0';
+        else if(t == str_t) key += *list[i].data_str;
+        else if(t == float_t) {
+            uint64_t bits = GroupKeys::float_bits(list[i].data_float);
+            key.append((const char*) &bits, 8);
+        } else {
+            rr_runtime_error("Cannot find unique elements of a List with elements of type "s + single_type_of(t));
+        }
+        if(seen.insert(key).second) rows.push_back(i);
+    }
+    return rows;
+}
+
+void check_frame_columns(const RRDataFrame& frame) {
+    for(int col = 0; col < frame.columns.size(); col++) {
+        if(frame.columns[col] == nullptr) rr_runtime_error("Cannot use a DataFrame that has given away a column");
+    }
+}
+
+int frame_key_column(const RRDataFrame& frame, const string& key) {
+    int col = frame.column_of(key);
+    if(col < 0) rr_runtime_error("DataFrame has no column '"s + key + "'");
+    return col;
+}
+
+//a new DataFrame with the rows of `frame` sorted by column `key`
+RRDataFrame* frame_sorted(const RRDataFrame& frame, const string& key) {
+    check_frame_columns(frame);
+    vector<size_t> rows = vec_argsort(*frame.columns[frame_key_column(frame, key)]);
+    RRDataFrame* res = new RRDataFrame();
+    res->names = frame.names;
+    for(int col = 0; col < frame.columns.size(); col++) res->columns.push_back(vec_gather(*frame.columns[col], rows));
+    return res;
+}
+
+//a new DataFrame with the distinct rows of `frame`, in the order they first appear
+RRDataFrame* frame_unique(const RRDataFrame& frame) {
+    check_frame_columns(frame);
+    if(frame.columns.empty()) return new RRDataFrame(frame);
+    //rows are grouped by the first column, then every group is split by each further column in turn
+    Grouping grouping = group_keys(*frame.columns[0]);
+    for(int col = 1; col < frame.columns.size(); col++) {
+        Grouping by_col = group_keys(*frame.columns[col]);
+        unordered_map<uint64_t, uint32_t> ids;
+        grouping.first_rows.clear();
+        for(size_t row = 0; row < grouping.group_of.size(); row++) {
+            uint64_t key = (uint64_t) grouping.group_of[row] << 32 | by_col.group_of[row];
+            auto id = ids.emplace(key, (uint32_t) ids.size());
+            if(id.second) grouping.first_rows.push_back(row);
+            grouping.group_of[row] = id.first->second;
+        }
+    }
+    RRDataFrame* res = new RRDataFrame();
+    res->names = frame.names;
+    for(int col = 0; col < frame.columns.size(); col++) res->columns.push_back(vec_gather(*frame.columns[col], grouping.first_rows));
+    return res;
+}
+
+//inner join of `left` and `right` on their columns `key`
+//rows come in the order of `left`, and rows of `right` with the same key in their own order
+//the result has the key column, then the other columns of `left`, then those of `right`
+// (a right column named like a left one gets the suffix `_right`)
+RRDataFrame* frame_join(const RRDataFrame& left, const RRDataFrame& right, const string& key) {
+    check_frame_columns(left);
+    check_frame_columns(right);
+    int left_key = frame_key_column(left, key);
+    int right_key = frame_key_column(right, key);
+    const RRVec& left_keys = *left.columns[left_key];
+    const RRVec& right_keys = *right.columns[right_key];
+    if(left_keys.holds_strs() != right_keys.holds_strs() || left_keys.holds_floats() != right_keys.holds_floats()) {
+        rr_runtime_error("Cannot join on columns of different types");
+    }
+
+    //build: group the right rows by key, and list the rows of every group together
+    Grouping grouping = group_keys(right_keys);
+    size_t ngroups = grouping.first_rows.size();
+    vector<size_t> group_start(ngroups + 1, 0);
+    for(size_t row = 0; row < grouping.group_of.size(); row++) group_start[grouping.group_of[row] + 1]++;
+    for(size_t group = 0; group < ngroups; group++) group_start[group + 1] += group_start[group];
+    vector<size_t> group_rows(grouping.group_of.size());
+    vector<size_t> next = group_start;
+    for(size_t row = 0; row < grouping.group_of.size(); row++) group_rows[next[grouping.group_of[row]]++] = row;
+
+    //probe: look up every left key among the groups
+    GroupKeys build_keys(right_keys);
+    GroupKeys probe_keys(left_keys);
+    GroupTable table(build_keys, grouping.first_rows, ngroups);
+    table.insert_groups();
+    vector<size_t> left_rows;
+    vector<size_t> right_rows;
+    for(size_t row = 0; row < left_keys.size(); row++) {
+        long long group = table.find(probe_keys, row);
+        if(group < 0) continue;
+        for(size_t at = group_start[group]; at < group_start[group + 1]; at++) {
+            left_rows.push_back(row);
+            right_rows.push_back(group_rows[at]);
+        }
+    }
+
+    RRDataFrame* res = new RRDataFrame();
+    res->names.push_back(key);
+    res->columns.push_back(vec_gather(left_keys, left_rows));
+    for(int col = 0; col < left.columns.size(); col++) {
+        if(col == left_key) continue;
+        res->names.push_back(left.names[col]);
+        res->columns.push_back(vec_gather(*left.columns[col], left_rows));
+    }
+    for(int col = 0; col < right.columns.size(); col++) {
+        if(col == right_key) continue;
+        res->names.push_back(res->column_of(right.names[col]) < 0 ? right.names[col] : right.names[col] + "_right");
+        res->columns.push_back(vec_gather(*right.columns[col], right_rows));
+    }
+    return res;
+}
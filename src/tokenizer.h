@@ -43,6 +43,8 @@ struct Token {
     string t;
     TokenType type;
     TokenInfo info;
+    int line = 0; //where the token starts in the source, both counted from 1
+    int col = 0;
 };
 
 struct CharClassifier {
@@ -92,6 +94,7 @@ struct CharClassifier {
         chars['!'] = CharType::C_SPECIAL;
         chars['`'] = CharType::C_SPECIAL;
         chars[':'] = CharType::C_SPECIAL;
+        chars['?'] = CharType::C_SPECIAL;
     }
 
     CharType type_of(char c) {
@@ -103,6 +106,10 @@ struct Tokenizer {
     string source; //should always end with a newline
     int at_char;
     CharClassifier cc;
+    int token_start = 0; //where the token being read starts
+    int line = 1; //line and start of line of `counted`; the source is only scanned forward once
+    int line_start = 0;
+    int counted = 0;
 
     static Tokenizer empty() {
         return Tokenizer { "\n", 0, CharClassifier() };
@@ -115,6 +122,10 @@ struct Tokenizer {
     void set_source(string source) {
         this->source = source.append(1, '\n');
         this->at_char = 0;
+        this->token_start = 0;
+        this->line = 1;
+        this->line_start = 0;
+        this->counted = 0;
     }
 
     void skip_comments() {
@@ -126,13 +137,33 @@ struct Tokenizer {
         }
     }
 
-    //return the next token
+    //count lines up to source position `pos`
+    void locate(int pos) {
+        for(; counted < pos; counted++) {
+            if(source[counted] == '\n') {
+                line++;
+                line_start = counted + 1;
+            }
+        }
+    }
+
+    //return the next token, with its line and column
     Token next() {
+        Token token = read_token();
+        locate(token_start);
+        token.line = line;
+        token.col = token_start - line_start + 1;
+        return token;
+    }
+
+    Token read_token() {
+        token_start = at_char;
         //check for eof
         if(done()) return Token { "", TokenType::T_NONE };
         //skip whitespace and comments
         while(cc.type_of(source[at_char]) == CharType::C_WHITESPACE) at_char++;
         skip_comments();
+        token_start = at_char;
         //identify the first character to look at
         CharType ctype = cc.type_of(source[at_char]);
         //if found a newline, get it
@@ -174,6 +205,9 @@ struct Tokenizer {
                 ctype = cc.type_of(source[at_char]);
             } while(ctype == CharType::C_LETTER || ctype == CharType::C_NUMBER);
             // at_char++;
+            if(token_str == "true" || token_str == "false") {
+                return Token { token_str, TokenType::T_LITERAL, TokenInfo::L_BOOL };
+            }
             return Token { token_str, TokenType::T_SYMBOL, TokenInfo::S_LETTER };
         }
         //read a symbol until non-special
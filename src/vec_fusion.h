@@ -0,0 +1,159 @@
+// Fused elementwise arithmetic on Vecs
+// A tree of `+` and `*` operators (like `a * b + c * d`) is compiled into a small stack program, which is run
+// over blocks of elements that fit in cache. Each input element is read once and only the result is allocated,
+// instead of a whole temporary Vec per operator.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "datatypes.h"
+#include "rr_obj.h"
+#include "rr_vec.h"
+#include "rr_error.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+//elements computed per pass of the program; one block of every stack slot stays in L1 cache
+const size_t FUSE_BLOCK = 1024;
+
+enum FuseOpCode {
+    FUSE_LEAF, //push an evaluated operand
+    FUSE_ADD,
+    FUSE_MUL
+};
+
+/*
+    Structs
+*/
+
+struct FuseInstr {
+    FuseOpCode op;
+    int leaf; //index of the operand, for FUSE_LEAF
+};
+
+//one value on the program's stack: the current block of its elements is at `data`,
+// which points either into an input Vec, or into `buf`
+template<typename T>
+struct FuseSlot {
+    vector<T> buf;
+    const T* data;
+};
+
+/*
+    Functions
+*/
+
+//run with compiled code when the program is hot, see vec_jit.h
+bool jit_fused(const vector<FuseInstr>& program, const vector<RRObj>& leaves, size_t len, bool floats, void* out);
+
+//whether `symbol` is an operator that can be part of a fused program
+bool fusable_op(const string& symbol) {
+    return symbol == "+" || symbol == "*";
+}
+
+FuseOpCode fuse_op_of(const string& symbol) {
+    return symbol == "+" ? FUSE_ADD : FUSE_MUL;
+}
+
+//check that operands `leaves` can be fused: at least one numeric Vec, all the Vecs of the same length,
+// and everything else Int or Float; `len` is set to the length and `floats` to whether the result is Float
+bool fusable_leaves(const vector<RRObj>& leaves, size_t& len, bool& floats) {
+    int vec_t = RRDataType("Vec").type;
+    int int_t = RRDataType("Int").type;
+    int float_t = RRDataType("Float").type;
+    bool any_vec = false;
+    floats = false;
+    for(int i = 0; i < leaves.size(); i++) {
+        int t = leaves[i].type.type;
+        if(t == vec_t) {
+            RRVec& vec = *leaves[i].data_vec;
+            if(vec.holds_strs()) return false;
+            if(any_vec && vec.size() != len) rr_runtime_error("Cannot combine Vecs of lengths "s + to_string(len) + " and " + to_string(vec.size()));
+            len = vec.size();
+            any_vec = true;
+            floats = floats || vec.holds_floats();
+        } else if(t == float_t) {
+            floats = true;
+        } else if(t != int_t) {
+            return false;
+        }
+    }
+    return any_vec;
+}
+
+//run `program` over elements [from, to) of the operands, writing the result to `out`
+template<typename T>
+void run_fused_block(const vector<FuseInstr>& program, const vector<RRObj>& leaves, vector<FuseSlot<T>>& stack, size_t from, size_t to, T* out) {
+    size_t n = to - from;
+    int top = 0;
+    for(int pc = 0; pc < program.size(); pc++) {
+        const FuseInstr& instr = program[pc];
+        bool last = pc + 1 == program.size();
+        if(instr.op == FUSE_LEAF) {
+            FuseSlot<T>& slot = stack[top++];
+            const RRObj& leaf = leaves[instr.leaf];
+            T* dest = last ? out : slot.buf.data();
+            if(leaf.type == RRDataType("Vec")) {
+                RRVec& vec = *leaf.data_vec;
+                //operands of the result's type are read in place, others are converted
+                if(vec.holds_floats() == is_same<T, double>::value && !last) {
+                    if(vec.holds_floats()) slot.data = (const T*) vec.float_data() + from;
+                    else slot.data = (const T*) vec.int_data() + from;
+                    continue;
+                }
+                if(vec.holds_floats()) copy(vec.float_data() + from, vec.float_data() + to, dest);
+                else copy(vec.int_data() + from, vec.int_data() + to, dest);
+            } else {
+                T value = leaf.type == RRDataType("Float") ? (T) leaf.data_float : (T) leaf.data_int;
+                fill(dest, dest + n, value);
+            }
+            slot.data = dest;
+            continue;
+        }
+        FuseSlot<T>& lhs = stack[top - 2];
+        FuseSlot<T>& rhs = stack[top - 1];
+        T* dest = last ? out : lhs.buf.data();
+        const T* a = lhs.data;
+        const T* b = rhs.data;
+        if(instr.op == FUSE_ADD) {
+            for(size_t i = 0; i < n; i++) dest[i] = a[i] + b[i];
+        } else {
+            for(size_t i = 0; i < n; i++) dest[i] = a[i] * b[i];
+        }
+        lhs.data = dest;
+        top--;
+    }
+}
+
+//fill `out` with `len` elements: `program` applied to `leaves` elementwise
+template<typename T>
+void run_fused(const vector<FuseInstr>& program, const vector<RRObj>& leaves, size_t len, vector<T>& out) {
+    out.resize(len);
+    vector<FuseSlot<T>> stack(program.size());
+    for(int i = 0; i < stack.size(); i++) stack[i].buf.resize(FUSE_BLOCK);
+    for(size_t from = 0; from < len; from += FUSE_BLOCK) {
+        size_t to = min(from + FUSE_BLOCK, len);
+        run_fused_block(program, leaves, stack, from, to, out.data() + from);
+    }
+}
+
+//`program` over `leaves` (already checked by `fusable_leaves`), as a new Vec
+RRVec* fused_vec(const vector<FuseInstr>& program, const vector<RRObj>& leaves, size_t len, bool floats) {
+    if(floats) {
+        RRVec* res = new RRVec(RRDataType("Float"));
+        res->floats.resize(len);
+        if(!jit_fused(program, leaves, len, true, res->floats.data())) run_fused(program, leaves, len, res->floats);
+        return res;
+    }
+    RRVec* res = new RRVec(RRDataType("Int"));
+    res->ints.resize(len);
+    if(!jit_fused(program, leaves, len, false, res->ints.data())) run_fused(program, leaves, len, res->ints);
+    return res;
+}
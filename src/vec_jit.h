@@ -0,0 +1,352 @@
+// Native code for hot fused Vec arithmetic (x86-64 Linux)
+// A fused program (see vec_fusion.h) is specialized to the types of its operands: which ones are Int Vecs,
+// Float Vecs or single values, and whether the result is Int or Float. Once a program has gone over enough
+// elements with the same operand types, it's compiled into a machine code loop, from a template per instruction:
+// every operand is loaded into a register, the operators work on registers, and only the result is stored.
+// Float programs over Float Vecs do two elements per instruction. A call with operand types the program wasn't
+// compiled for (or a program needing more registers than there are) runs in the interpreter, as before.
+// Disable with `--no-jit`; `--perf-map` writes /tmp/perf-<pid>.map, so `perf report` can name the compiled code.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#if defined(__x86_64__) && defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "datatypes.h"
+#include "rr_obj.h"
+#include "rr_vec.h"
+#include "vec_fusion.h"
+
+using namespace std;
+
+/*
+    Definitions
+*/
+
+bool rr_jit = true;
+bool rr_jit_perf_map = false;
+
+//elements a program goes over, with the same operand types, before it gets compiled
+const size_t JIT_HOT_ELEMENTS = 1 << 15;
+//shorter Vecs always run in the interpreter; looking up compiled code would take longer than the work
+const size_t JIT_MIN_LEN = 64;
+//compiled programs are never released, so there are at most this many
+const size_t JIT_MAX_KERNELS = 1024;
+
+//registers holding the stack of an Int program: r8-r11, rbx, r12-r15; Float programs use xmm0-xmm15
+const int JIT_INT_REGS[] = {8, 9, 10, 11, 3, 12, 13, 14, 15};
+const int JIT_INT_DEPTH = 9;
+const int JIT_FLOAT_DEPTH = 16;
+
+//kind of an operand, in a program's type signature
+const char JIT_INT_VEC = 'i';
+const char JIT_FLOAT_VEC = 'f';
+const char JIT_SCALAR = 's'; //a single value, given in the result's type
+
+//compiled program: `out[i] = program(operands[0][i], operands[1][i], ...)` for i < n
+//single-value operands point to one value of the result's type
+typedef void (*JitKernel)(const void* const* operands, void* out, size_t n);
+
+/*
+    Structs
+*/
+
+//a program with a type signature, and its compiled code once it's hot
+struct JitEntry {
+    size_t elements = 0;
+    JitKernel kernel = nullptr;
+    bool failed = false; //can't be compiled; it always runs in the interpreter
+};
+
+struct JitCache {
+    mutex lock;
+    unordered_map<string, JitEntry> entries;
+    size_t kernels = 0;
+    FILE* perf_map = nullptr;
+};
+
+JitCache jit_cache;
+
+//machine code being written, x86-64 encoding
+struct JitCode {
+    vector<uint8_t> bytes;
+
+    void byte(uint8_t b) {
+        bytes.push_back(b);
+    }
+    void u32(uint32_t v) {
+        for(int i = 0; i < 4; i++) byte(v >> (8 * i));
+    }
+    //REX prefix, only when one of its bits is needed
+    void rex(bool w, int reg, int base) {
+        uint8_t r = 0x40 | w << 3 | (reg >> 3) << 2 | (base >> 3);
+        if(r != 0x40) byte(r);
+    }
+    void modrm(int mod, int reg, int rm) {
+        byte(mod << 6 | (reg & 7) << 3 | (rm & 7));
+    }
+    //`[rax + rcx*8]`, the element of an operand
+    void operand_element(int reg) {
+        modrm(0, reg, 4);
+        byte(0xC8);
+    }
+    //`[rsi + rcx*8]`, the element of the result
+    void out_element(int reg) {
+        modrm(0, reg, 4);
+        byte(0xCE);
+    }
+    //`mov rax, [rdi + 8*i]`: the pointer to operand `i`
+    void load_operand_ptr(int i) {
+        byte(0x48); byte(0x8B); byte(0x87);
+        u32(8 * i);
+    }
+    //an SSE instruction `prefix 0F op` on xmm register `reg` and `rm`
+    void sse(uint8_t prefix, bool w, uint8_t op, int reg, int rm) {
+        byte(prefix);
+        rex(w, reg, rm);
+        byte(0x0F);
+        byte(op);
+    }
+    //a rel32 jump to patch later; returns where the offset is
+    size_t jump(uint8_t op1, int op2 = -1) {
+        byte(op1);
+        if(op2 >= 0) byte(op2);
+        u32(0);
+        return bytes.size() - 4;
+    }
+    void patch(size_t at, size_t target) {
+        int32_t rel = (int32_t) target - (int32_t) (at + 4);
+        memcpy(&bytes[at], &rel, 4);
+    }
+};
+
+/*
+    Functions
+*/
+
+//the program and the types of its operands, as a key for the cache
+string jit_signature(const vector<FuseInstr>& program, const vector<RRObj>& leaves, bool floats) {
+    string key = floats ? "f:" : "i:";
+    for(int i = 0; i < leaves.size(); i++) {
+        if(!(leaves[i].type == RRDataType("Vec"))) key += JIT_SCALAR;
+        else key += leaves[i].data_vec->holds_floats() ? JIT_FLOAT_VEC : JIT_INT_VEC;
+    }
+    key += ':';
+    for(int pc = 0; pc < program.size(); pc++) {
+        if(program[pc].op == FUSE_LEAF) key += to_string(program[pc].leaf);
+        else key += program[pc].op == FUSE_ADD ? '+' : '*';
+        key += ' ';
+    }
+    return key;
+}
+
+//deepest the program's stack gets
+int jit_stack_depth(const vector<FuseInstr>& program) {
+    int top = 0;
+    int depth = 0;
+    for(int pc = 0; pc < program.size(); pc++) {
+        top += program[pc].op == FUSE_LEAF ? 1 : -1;
+        depth = max(depth, top);
+    }
+    return depth;
+}
+
+//the loop body for one element, or two if `packed`
+void jit_emit_body(JitCode& code, const vector<FuseInstr>& program, const string& kinds, bool floats, bool packed) {
+    uint8_t width = packed ? 0x66 : 0xF2; //movupd/addpd/mulpd, or movsd/addsd/mulsd
+    int top = 0;
+    for(int pc = 0; pc < program.size(); pc++) {
+        const FuseInstr& instr = program[pc];
+        if(instr.op == FUSE_LEAF) {
+            char kind = kinds[instr.leaf];
+            code.load_operand_ptr(instr.leaf);
+            if(floats) {
+                int xmm = top;
+                if(kind == JIT_FLOAT_VEC) {
+                    code.sse(width, false, 0x10, xmm, 0); //movupd/movsd xmm, [rax + rcx*8]
+                    code.operand_element(xmm);
+                } else if(kind == JIT_INT_VEC) {
+                    code.sse(0xF2, true, 0x2A, xmm, 0); //cvtsi2sd xmm, qword [rax + rcx*8]
+                    code.operand_element(xmm);
+                } else {
+                    code.sse(0xF2, false, 0x10, xmm, 0); //movsd xmm, [rax]
+                    code.modrm(0, xmm, 0);
+                    if(packed) {
+                        code.sse(0x66, false, 0x14, xmm, xmm); //unpcklpd xmm, xmm
+                        code.modrm(3, xmm, xmm);
+                    }
+                }
+            } else {
+                int reg = JIT_INT_REGS[top];
+                code.rex(true, reg, 0);
+                code.byte(0x8B); //mov reg, [rax + rcx*8] or [rax]
+                if(kind == JIT_SCALAR) code.modrm(0, reg, 0);
+                else code.operand_element(reg);
+            }
+            top++;
+            continue;
+        }
+        top--;
+        if(floats) {
+            code.sse(width, false, instr.op == FUSE_ADD ? 0x58 : 0x59, top - 1, top); //add/mul xmm(top-1), xmm(top)
+            code.modrm(3, top - 1, top);
+        } else {
+            int dst = JIT_INT_REGS[top - 1];
+            int src = JIT_INT_REGS[top];
+            if(instr.op == FUSE_ADD) {
+                code.rex(true, src, dst);
+                code.byte(0x01); //add dst, src
+                code.modrm(3, src, dst);
+            } else {
+                code.rex(true, dst, src);
+                code.byte(0x0F); code.byte(0xAF); //imul dst, src
+                code.modrm(3, dst, src);
+            }
+        }
+    }
+    if(floats) {
+        code.sse(width, false, 0x11, 0, 0); //movupd/movsd [rsi + rcx*8], xmm0
+        code.out_element(0);
+    } else {
+        code.rex(true, JIT_INT_REGS[0], 0);
+        code.byte(0x89); //mov [rsi + rcx*8], r8
+        code.out_element(JIT_INT_REGS[0]);
+    }
+}
+
+//machine code for `program` over operands of `kinds`; rdi = operands, rsi = out, rdx = n, and rcx counts elements
+void jit_emit_kernel(JitCode& code, const vector<FuseInstr>& program, const string& kinds, bool floats) {
+    static const uint8_t PUSHES[] = {0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}; //rbx, r12-r15
+    static const uint8_t POPS[] = {0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B};
+    if(!floats) for(int i = 0; i < sizeof(PUSHES); i++) code.byte(PUSHES[i]);
+    code.byte(0x31); code.byte(0xC9); //xor ecx, ecx
+
+    //two elements at a time while there are two left, when all Vec operands are Floats
+    bool packed = floats && kinds.find(JIT_INT_VEC) == string::npos;
+    if(packed) {
+        size_t loop = code.bytes.size();
+        code.byte(0x48); code.byte(0x8D); code.byte(0x41); code.byte(0x02); //lea rax, [rcx + 2]
+        code.byte(0x48); code.byte(0x39); code.byte(0xD0); //cmp rax, rdx
+        size_t exit = code.jump(0x0F, 0x87); //ja
+        jit_emit_body(code, program, kinds, floats, true);
+        code.byte(0x48); code.byte(0x83); code.byte(0xC1); code.byte(0x02); //add rcx, 2
+        code.patch(code.jump(0xE9), loop); //jmp
+        code.patch(exit, code.bytes.size());
+    }
+    size_t loop = code.bytes.size();
+    code.byte(0x48); code.byte(0x39); code.byte(0xD1); //cmp rcx, rdx
+    size_t done = code.jump(0x0F, 0x83); //jae
+    jit_emit_body(code, program, kinds, floats, false);
+    code.byte(0x48); code.byte(0xFF); code.byte(0xC1); //inc rcx
+    code.patch(code.jump(0xE9), loop); //jmp
+    code.patch(done, code.bytes.size());
+
+    if(!floats) for(int i = 0; i < sizeof(POPS); i++) code.byte(POPS[i]);
+    code.byte(0xC3); //ret
+}
+
+//the program written with operators, for the perf map
+string jit_describe(const vector<FuseInstr>& program) {
+    vector<string> stack;
+    for(int pc = 0; pc < program.size(); pc++) {
+        if(program[pc].op == FUSE_LEAF) {
+            stack.push_back("$" + to_string(program[pc].leaf));
+            continue;
+        }
+        string rhs = stack.back();
+        stack.pop_back();
+        stack.back() = "(" + stack.back() + (program[pc].op == FUSE_ADD ? " + " : " * ") + rhs + ")";
+    }
+    return stack.back();
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+//compile `program` for operands of `kinds` into executable memory; nullptr if it can't be
+JitKernel jit_compile(const vector<FuseInstr>& program, const string& kinds, bool floats) {
+    if(jit_stack_depth(program) > (floats ? JIT_FLOAT_DEPTH : JIT_INT_DEPTH)) return nullptr;
+    JitCode code;
+    jit_emit_kernel(code, program, kinds, floats);
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (code.bytes.size() + page - 1) / page * page;
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED) return nullptr;
+    memcpy(mem, code.bytes.data(), code.bytes.size());
+    //never writable and executable at once
+    if(mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return nullptr;
+    }
+    if(rr_jit_perf_map) {
+        if(jit_cache.perf_map == nullptr) {
+            string path = "/tmp/perf-" + to_string(getpid()) + ".map";
+            jit_cache.perf_map = fopen(path.c_str(), "w");
+        }
+        if(jit_cache.perf_map != nullptr) {
+            fprintf(jit_cache.perf_map, "%lx %zx rr-jit %s %s %s\n", (unsigned long) mem, code.bytes.size(),
+                floats ? "Float" : "Int", kinds.c_str(), jit_describe(program).c_str());
+            fflush(jit_cache.perf_map);
+        }
+    }
+    return (JitKernel) mem;
+}
+
+#else
+
+JitKernel jit_compile(const vector<FuseInstr>& program, const string& kinds, bool floats) {
+    return nullptr;
+}
+
+#endif
+
+//run `program` over `leaves` (already checked by `fusable_leaves`) with compiled code, writing `len` elements to `out`;
+// false if it isn't compiled (yet), and has to run in the interpreter
+bool jit_fused(const vector<FuseInstr>& program, const vector<RRObj>& leaves, size_t len, bool floats, void* out) {
+    if(!rr_jit || len < JIT_MIN_LEN) return false;
+    string key = jit_signature(program, leaves, floats);
+    JitKernel kernel;
+    {
+        lock_guard<mutex> guard(jit_cache.lock);
+        JitEntry& entry = jit_cache.entries[key];
+        if(entry.kernel == nullptr) {
+            entry.elements += len;
+            if(entry.failed || entry.elements < JIT_HOT_ELEMENTS || jit_cache.kernels >= JIT_MAX_KERNELS) return false;
+            entry.kernel = jit_compile(program, key.substr(2, leaves.size()), floats);
+            if(entry.kernel == nullptr) {
+                entry.failed = true;
+                return false;
+            }
+            jit_cache.kernels++;
+        }
+        kernel = entry.kernel;
+    }
+
+    //single values, converted to the result's type like the interpreter does
+    vector<long long> ints(leaves.size());
+    vector<double> doubles(leaves.size());
+    vector<const void*> operands(leaves.size());
+    for(int i = 0; i < leaves.size(); i++) {
+        const RRObj& leaf = leaves[i];
+        if(leaf.type == RRDataType("Vec")) {
+            RRVec& vec = *leaf.data_vec;
+            operands[i] = vec.holds_floats() ? (const void*) vec.float_data() : (const void*) vec.int_data();
+        } else if(floats) {
+            doubles[i] = leaf.type == RRDataType("Float") ? leaf.data_float : (double) leaf.data_int;
+            operands[i] = &doubles[i];
+        } else {
+            ints[i] = leaf.data_int;
+            operands[i] = &ints[i];
+        }
+    }
+    kernel(operands.data(), out, len);
+    return true;
+}